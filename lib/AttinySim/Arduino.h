@@ -0,0 +1,79 @@
+/*!
+   \file Arduino.h
+   \brief Stand-in for the ATtiny85 Arduino core on the native build.
+
+   Only what the firmware and its bundled libraries use is provided; every
+   call is routed into the simulator so it costs virtual time the way it
+   would on the part.
+ */
+
+#ifndef Arduino_h
+#define Arduino_h
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+
+#define HIGH 0x1
+#define LOW  0x0
+
+#define INPUT        0x0
+#define OUTPUT       0x1
+#define INPUT_PULLUP 0x2
+
+typedef bool    boolean;
+typedef uint8_t byte;
+
+template<class T, class U>
+static inline T min(T a, U b)
+{
+  return (b < a) ? (T)b : a;
+}
+
+template<class T, class U>
+static inline T max(T a, U b)
+{
+  return (a < b) ? (T)b : a;
+}
+
+template<class T, class L, class H>
+static inline T constrain(T x, L low, H high)
+{
+  return (x < low) ? (T)low : ((x > high) ? (T)high : x);
+}
+
+#define lowByte(w)  ((uint8_t)((w) & 0xff))
+#define highByte(w) ((uint8_t)((w) >> 8))
+
+#define noInterrupts() cli()
+#define interrupts()   sei()
+
+#define digitalPinToPort(pin)    (0)
+#define digitalPinToBitMask(pin) ((uint8_t)_BV(pin))
+#define portInputRegister(port)  (&sim_port_token)
+
+extern volatile uint8_t sim_port_token;
+
+void          pinMode(uint8_t pin, uint8_t mode);
+void          digitalWrite(uint8_t pin, uint8_t value);
+int           digitalRead(uint8_t pin);
+int           analogRead(uint8_t channel);
+unsigned long millis(void);
+unsigned long micros(void);
+void          delay(unsigned long ms);
+void          delayMicroseconds(unsigned int us);
+
+// direct port access used by OneWire, see OneWire.h
+uint8_t sim_direct_read(volatile uint8_t *base, uint8_t mask);
+void    sim_direct_mode(volatile uint8_t *base, uint8_t mask, uint8_t output);
+void    sim_direct_write(volatile uint8_t *base, uint8_t mask, uint8_t high);
+
+void setup(void);
+void loop(void);
+
+#endif // ifndef Arduino_h
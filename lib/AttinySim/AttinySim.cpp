@@ -0,0 +1,821 @@
+/*!
+   \file AttinySim.cpp
+   \brief Virtual clock, interrupts, register file, ADC, Timer1, pins, EEPROM
+   and the USI/TWI slave of the simulated ATtiny85.
+ */
+
+#include <Arduino.h>
+#include <EEPROM.h>
+#include <TinyWireS.h>
+#include <avr/sleep.h>
+
+#include <algorithm>
+#include <deque>
+#include <vector>
+
+#ifndef F_CPU
+# define F_CPU 8000000L
+#endif // ifndef F_CPU
+
+namespace sim
+{
+static const uint64_t NS_PER_CYCLE     = 1000000000ULL / F_CPU;
+static const uint64_t TIMER0_PERIOD_NS = 64ULL * 256ULL * NS_PER_CYCLE; // prescaler 64, 8 bit overflow
+static const uint64_t EEPROM_WRITE_NS  = 3400000ULL;
+static const uint16_t EEPROM_SIZE      = E2END + 1;
+static const uint64_t NEVER            = ~0ULL;
+
+static uint64_t clockNs;
+static bool     globalIrq = true;
+static uint64_t maskedSince;
+static Stats    counters;
+
+static uint8_t registers[REG_COUNT];
+
+static bool     adcBusy;
+static bool     adcFirst = true;
+static uint64_t adcDoneAt = NEVER;
+static uint16_t adcSample;
+static uint16_t adcResult;
+static uint8_t  adcHigh;
+
+static uint64_t t1Zero;            // when TCNT1 last counted from 0
+static uint64_t t1MatchAt = NEVER; // next TCNT1 == OCR1A
+
+static std::vector<Event> timeline;
+static std::deque<Event>  deferred;
+
+static uint8_t  eeprom[EEPROM_SIZE];
+static uint32_t eepromWrites[EEPROM_SIZE];
+static bool     eepromLoaded;
+static uint64_t eepromBusyUntil;
+
+static uint8_t  twiAddress;
+static void     (*twiReceiveHandler)(uint8_t);
+static void     (*twiRequestHandler)(void);
+static uint8_t  rxBuffer[TWI_RX_BUFFER_SIZE];
+static uint8_t  rxHead, rxCount;
+static uint8_t  txBuffer[TWI_TX_BUFFER_SIZE];
+static uint8_t  txHead, txCount;
+static bool     stopPending;
+static uint64_t rxArrivedAt;
+
+static void fireDue();
+static void runPendingInterrupts();
+
+Stats& stats()
+{
+  return counters;
+}
+
+uint64_t now()
+{
+  return clockNs;
+}
+
+static uint64_t nextTimelineEvent()
+{
+  return timeline.empty() ? NEVER : timeline.front().at;
+}
+
+void advance(uint64_t ns)
+{
+  uint64_t target = clockNs + ns;
+
+  if (globalIrq) runPendingInterrupts();
+
+  for (;;)
+  {
+    uint64_t next = std::min(std::min(nextTimelineEvent(), adcDoneAt), t1MatchAt);
+
+    if (next > target) break;
+    if (next > clockNs) clockNs = next;
+    fireDue();
+  }
+  if (target > clockNs) clockNs = target;
+}
+
+void cycles(uint32_t count)
+{
+  advance(count * NS_PER_CYCLE);
+}
+
+void sleepUntilWake()
+{
+  uint64_t start = clockNs;
+  uint64_t wake  = (clockNs / TIMER0_PERIOD_NS + 1) * TIMER0_PERIOD_NS;
+
+  if (nextTimelineEvent() < wake) wake = nextTimelineEvent();
+  if ((registers[REG_ADCSRA] & _BV(ADIE)) && (adcDoneAt < wake)) wake = adcDoneAt;
+  if ((registers[REG_TIMSK] & _BV(OCIE1A)) && (t1MatchAt < wake)) wake = t1MatchAt;
+  if (wake > clockNs) advance(wake - clockNs);
+  counters.sleepNs += clockNs - start;
+}
+
+bool interruptsEnabled()
+{
+  return globalIrq;
+}
+
+void setInterrupts(bool enabled)
+{
+  if (enabled == globalIrq) return;
+
+  globalIrq = enabled;
+  if (!enabled)
+  {
+    maskedSince = clockNs;
+    return;
+  }
+  counters.maskedMaxNs = std::max(counters.maskedMaxNs, clockNs - maskedSince);
+  runPendingInterrupts();
+}
+
+// Run an interrupt handler the way the hardware would: I cleared on entry,
+// restored by RETI, and not counted as a masked window of the main program.
+// Vectoring, a typical prologue/epilogue and RETI cost about 20 cycles.
+template<typename F>static void isr(F handler)
+{
+  uint64_t start = clockNs;
+
+  globalIrq = false;
+  cycles(20);
+  handler();
+  counters.isrMaxNs = std::max(counters.isrMaxNs, clockNs - start);
+  globalIrq = true;
+  runPendingInterrupts();
+}
+
+/* ---------------------------------------------------------------------- */
+/* ADC                                                                     */
+/* ---------------------------------------------------------------------- */
+
+static uint64_t adcClockNs()
+{
+  static const uint8_t divisor[] = { 2, 2, 4, 8, 16, 32, 64, 128 };
+
+  return divisor[registers[REG_ADCSRA] & 0x07] * NS_PER_CYCLE;
+}
+
+static float adcReference()
+{
+  uint8_t admux = registers[REG_ADMUX];
+
+  if (!(admux & _BV(REFS1))) return model().vcc;
+
+  return (admux & _BV(REFS2)) ? 2.56f : 1.1f;
+}
+
+static float gaussian()
+{
+  // Box-Muller on a small LCG so runs are reproducible across hosts.
+  static uint32_t state = 0x2545F491;
+  float u1, u2;
+
+  do {
+    state = state * 1664525UL + 1013904223UL;
+    u1    = (state >> 8) / 16777216.0f;
+  } while (u1 <= 0);
+  state = state * 1664525UL + 1013904223UL;
+  u2    = (state >> 8) / 16777216.0f;
+  return sqrtf(-2.0f * logf(u1)) * cosf(6.2831853f * u2);
+}
+
+static void adcStart()
+{
+  uint8_t mux   = registers[REG_ADMUX] & 0x0F;
+  float   value = analogVoltage(mux) / adcReference() * 1024.0f;
+
+  value += model().noiseLsb * gaussian();
+  value  = floorf(value + 0.5f);
+  if (value < 0) value = 0;
+  if (value > 1023) value = 1023;
+
+  adcSample  = (uint16_t)value;
+  adcBusy    = true;
+  adcDoneAt  = clockNs + (adcFirst ? 25 : 13) * adcClockNs();
+  adcFirst   = false;
+  registers[REG_ADCSRA] |= _BV(ADSC);
+}
+
+static void adcComplete()
+{
+  bool freeRunning = (registers[REG_ADCSRA] & _BV(ADATE)) && !(registers[REG_ADCSRB] & 0x07);
+
+  counters.adcConversions++;
+  adcResult = adcSample;
+  registers[REG_ADCSRA] |= _BV(ADIF);
+  adcBusy   = false;
+  adcDoneAt = NEVER;
+  registers[REG_ADCSRA] &= ~_BV(ADSC);
+  if (freeRunning) adcStart();
+}
+
+static void adcInterrupt()
+{
+  if (!globalIrq) return;
+
+  if ((registers[REG_ADCSRA] & (_BV(ADIF) | _BV(ADIE))) != (_BV(ADIF) | _BV(ADIE))) return;
+
+  registers[REG_ADCSRA] &= ~_BV(ADIF);
+  if (ADC_vect) isr(ADC_vect);
+}
+
+static void writeAdcsra(uint8_t value)
+{
+  uint8_t old = registers[REG_ADCSRA];
+
+  // ADIF is cleared by writing a one to it
+  uint8_t flag = (value & _BV(ADIF)) ? 0 : (old & _BV(ADIF));
+
+  registers[REG_ADCSRA] = (value & ~(_BV(ADIF) | _BV(ADSC))) | flag | (old & _BV(ADSC));
+
+  if (!(value & _BV(ADEN)))
+  {
+    adcBusy   = false;
+    adcDoneAt = NEVER;
+    registers[REG_ADCSRA] &= ~_BV(ADSC);
+    return;
+  }
+  if (!(old & _BV(ADEN))) adcFirst = true;
+  if ((value & _BV(ADSC)) && !adcBusy) adcStart();
+}
+
+/* ---------------------------------------------------------------------- */
+/* Timer1                                                                  */
+/* ---------------------------------------------------------------------- */
+
+// Normal mode only: TCNT1 counts 0..255 at the CS1 prescaler and compare
+// match A sets OCF1A. PRTIM1 or a zero prescaler stops it.
+static uint64_t timer1TickNs()
+{
+  uint8_t cs = registers[REG_TCCR1] & 0x0F;
+
+  if (!cs || (registers[REG_PRR] & _BV(PRTIM1))) return 0;
+
+  return (1ULL << (cs - 1)) * NS_PER_CYCLE;
+}
+
+static uint8_t timer1Count()
+{
+  uint64_t tick = timer1TickNs();
+
+  return tick ? ((clockNs - t1Zero) / tick) & 0xFF : registers[REG_TCNT1];
+}
+
+static void timer1Schedule()
+{
+  uint64_t tick = timer1TickNs();
+
+  if (!tick)
+  {
+    t1MatchAt = NEVER;
+    return;
+  }
+
+  uint64_t count = (clockNs - t1Zero) / tick;
+  uint64_t match = (count & ~0xFFULL) + registers[REG_OCR1A];
+
+  if (match <= count) match += 256;
+  t1MatchAt = t1Zero + match * tick;
+}
+
+// Register writes that may change the clock keep the count where it was.
+static void timer1Write(uint8_t reg, uint8_t value)
+{
+  uint8_t count = timer1Count();
+
+  registers[reg] = value;
+  if (reg == REG_TCNT1) count = value;
+  registers[REG_TCNT1] = count;
+  t1Zero = clockNs - count * timer1TickNs();
+  timer1Schedule();
+}
+
+static void timer1Match()
+{
+  registers[REG_TIFR] |= _BV(OCF1A);
+  t1MatchAt += 256 * timer1TickNs();
+}
+
+static void timer1Interrupt()
+{
+  if (!globalIrq) return;
+
+  if ((registers[REG_TIFR] & registers[REG_TIMSK] & _BV(OCF1A)) == 0) return;
+
+  registers[REG_TIFR] &= ~_BV(OCF1A);
+  if (TIMER1_COMPA_vect) isr(TIMER1_COMPA_vect);
+}
+
+/* ---------------------------------------------------------------------- */
+/* Register file                                                           */
+/* ---------------------------------------------------------------------- */
+
+static bool masterLow()
+{
+  return (registers[REG_DDRB] & _BV(PB5)) && !(registers[REG_PORTB] & _BV(PB5));
+}
+
+static void writePort(uint8_t reg, uint8_t value)
+{
+  bool wasLow = masterLow();
+
+  if (registers[reg] == value) return;
+
+  electrodeUpdate();
+  registers[reg] = value;
+  if (masterLow() != wasLow) oneWireEdge(!wasLow);
+}
+
+static uint8_t readPins()
+{
+  uint8_t value = 0;
+
+  for (uint8_t pin = 0; pin < 6; pin++)
+  {
+    if (sim::digitalRead(pin)) value |= _BV(pin);
+  }
+  return value;
+}
+
+uint8_t readRegister(uint8_t reg)
+{
+  cycles(1);
+
+  switch (reg)
+  {
+  case REG_ADCL:
+    adcHigh = adcResult >> 8;
+    return (registers[REG_ADMUX] & _BV(ADLAR)) ? (adcResult << 6) : (adcResult & 0xFF);
+
+  case REG_ADCH:
+    return (registers[REG_ADMUX] & _BV(ADLAR)) ? (adcResult >> 2) : adcHigh;
+
+  case REG_PINB:
+    return readPins();
+
+  case REG_SREG:
+    return globalIrq ? 0x80 : 0;
+
+  case REG_TCNT1:
+    return timer1Count();
+  }
+  return registers[reg];
+}
+
+uint8_t peekRegister(uint8_t reg)
+{
+  return registers[reg];
+}
+
+void writeRegister(uint8_t reg, uint8_t value)
+{
+  cycles(1);
+
+  switch (reg)
+  {
+  case REG_ADCSRA:
+    writeAdcsra(value);
+    return;
+
+  case REG_PORTB:
+  case REG_DDRB:
+    writePort(reg, value & 0x3F);
+    return;
+
+  case REG_PINB:
+    // writing a one to PINx toggles the output latch
+    writePort(REG_PORTB, registers[REG_PORTB] ^ (value & 0x3F));
+    return;
+
+  case REG_SREG:
+    setInterrupts(value & 0x80);
+    return;
+
+  case REG_ADCL:
+  case REG_ADCH:
+    return;
+
+  case REG_PRR:
+  case REG_TCCR1:
+  case REG_TCNT1:
+  case REG_OCR1A:
+    timer1Write(reg, value);
+    return;
+
+  case REG_TIFR:
+    // flags are cleared by writing a one to them
+    registers[reg] &= ~value;
+    return;
+
+  case REG_TIMSK:
+    registers[reg] = value;
+    timer1Interrupt();
+    return;
+  }
+  registers[reg] = value;
+}
+
+/* ---------------------------------------------------------------------- */
+/* Pins                                                                    */
+/* ---------------------------------------------------------------------- */
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+  uint8_t ddr  = registers[REG_DDRB];
+  uint8_t port = registers[REG_PORTB];
+
+  if (pin > 5) return;
+
+  cycles(40);
+  if (mode == OUTPUT)
+  {
+    writePort(REG_DDRB, ddr | _BV(pin));
+    return;
+  }
+  writePort(REG_DDRB, ddr & ~_BV(pin));
+  writePort(REG_PORTB, (mode == INPUT_PULLUP) ? (port | _BV(pin)) : (port & ~_BV(pin)));
+}
+
+void digitalWrite(uint8_t pin, uint8_t value)
+{
+  if (pin > 5) return;
+
+  cycles(50);
+  writePort(REG_PORTB, value ? (registers[REG_PORTB] | _BV(pin)) : (registers[REG_PORTB] & ~_BV(pin)));
+}
+
+uint8_t digitalRead(uint8_t pin)
+{
+  static const uint8_t channel[] = { 0xFF, 1, 3, 2, 0xFF, 0 }; // PBn -> ADCn
+
+  if (pin > 5) return 0;
+
+  if (registers[REG_DDRB] & _BV(pin)) return (registers[REG_PORTB] >> pin) & 1;
+
+  if (pin == PB5) return oneWireLine();
+
+  if (channel[pin] != 0xFF) return analogVoltage(channel[pin]) > model().vcc / 2;
+
+  return (registers[REG_PORTB] >> pin) & 1;
+}
+
+int analogRead(uint8_t channel)
+{
+  // same sequence as the ATtiny core: select the channel, start, spin
+  writeRegister(REG_ADMUX, (registers[REG_ADMUX] & 0xF0) | (channel & 0x0F));
+  writeRegister(REG_ADCSRA, registers[REG_ADCSRA] | _BV(ADSC));
+
+  while (readRegister(REG_ADCSRA) & _BV(ADSC)) cycles(2);
+
+  uint8_t low = readRegister(REG_ADCL);
+
+  return low | (readRegister(REG_ADCH) << 8);
+}
+
+/* ---------------------------------------------------------------------- */
+/* EEPROM                                                                  */
+/* ---------------------------------------------------------------------- */
+
+static void eepromWait()
+{
+  if (!eepromLoaded)
+  {
+    memset(eeprom, 0xFF, sizeof(eeprom));
+    eepromLoaded = true;
+  }
+  if (eepromBusyUntil > clockNs) advance(eepromBusyUntil - clockNs);
+}
+
+uint8_t eepromRead(uint16_t address)
+{
+  eepromWait();
+  cycles(4);
+  return eeprom[address % EEPROM_SIZE];
+}
+
+void eepromWrite(uint16_t address, uint8_t value)
+{
+  eepromWait();
+  cycles(8);
+  address %= EEPROM_SIZE;
+  eeprom[address] = value;
+  eepromWrites[address]++;
+  counters.eepromWrites++;
+  eepromBusyUntil = clockNs + EEPROM_WRITE_NS;
+}
+
+void eepromLoad(uint16_t address, uint8_t value)
+{
+  eepromWait();
+  eeprom[address % EEPROM_SIZE] = value;
+}
+
+bool eepromReady()
+{
+  cycles(1);
+  return eepromBusyUntil <= clockNs;
+}
+
+uint16_t eepromLength()
+{
+  return EEPROM_SIZE;
+}
+
+uint32_t eepromWear(uint16_t address)
+{
+  return eepromWrites[address % EEPROM_SIZE];
+}
+
+/* ---------------------------------------------------------------------- */
+/* USI/TWI slave                                                           */
+/* ---------------------------------------------------------------------- */
+
+void twiBegin(uint8_t address)
+{
+  twiAddress = address;
+}
+
+void twiOnReceive(void (*handler)(uint8_t))
+{
+  twiReceiveHandler = handler;
+}
+
+void twiOnRequest(void (*handler)(void))
+{
+  twiRequestHandler = handler;
+}
+
+void twiSend(uint8_t data)
+{
+  cycles(10);
+  if (txCount == TWI_TX_BUFFER_SIZE) return;
+
+  txBuffer[(txHead + txCount++) % TWI_TX_BUFFER_SIZE] = data;
+}
+
+uint8_t twiAvailable()
+{
+  return rxCount;
+}
+
+uint8_t twiReceive()
+{
+  cycles(10);
+  if (!rxCount) return 0;
+
+  uint8_t data = rxBuffer[rxHead];
+
+  rxHead = (rxHead + 1) % TWI_RX_BUFFER_SIZE;
+  rxCount--;
+  return data;
+}
+
+static void deliverReceive()
+{
+  uint64_t latency = clockNs - rxArrivedAt;
+
+  counters.twiReceives++;
+  counters.twiLatencySumNs += latency;
+  counters.twiLatencyMaxNs  = std::max(counters.twiLatencyMaxNs, latency);
+  stopPending               = false;
+  twiReceiveHandler(rxCount);
+}
+
+void twiStopCheck()
+{
+  cycles(10);
+  if (!twiReceiveHandler || !stopPending || !rxCount) return;
+
+  deliverReceive();
+}
+
+// Start condition: data left over from the previous write is handed to the
+// receive callback from inside the USI start interrupt.
+static bool twiStart(uint8_t address)
+{
+  counters.twiTransactions++;
+  if (twiReceiveHandler && rxCount) deliverReceive();
+  if (address == twiAddress) return true;
+
+  counters.twiNacks++;
+  return false;
+}
+
+bool twiMasterWrite(uint8_t address, const uint8_t *data, uint8_t length)
+{
+  if (!twiStart(address)) return false;
+
+  for (uint8_t i = 0; i < length; i++)
+  {
+    if (rxCount == TWI_RX_BUFFER_SIZE)
+    {
+      counters.twiNacks++;
+      return false;
+    }
+    rxBuffer[(rxHead + rxCount++) % TWI_RX_BUFFER_SIZE] = data[i];
+  }
+  rxArrivedAt = clockNs;
+  stopPending = true;
+  return true;
+}
+
+bool twiMasterRead(uint8_t address, uint8_t *data, uint8_t length)
+{
+  memset(data, 0xFF, length);
+  if (!twiStart(address)) return false;
+
+  for (uint8_t i = 0; i < length; i++)
+  {
+    if (!txCount && twiRequestHandler) twiRequestHandler();
+    if (!txCount) continue;
+
+    data[i] = txBuffer[txHead];
+    txHead  = (txHead + 1) % TWI_TX_BUFFER_SIZE;
+    txCount--;
+  }
+  return true;
+}
+
+/* ---------------------------------------------------------------------- */
+/* Scripted events                                                         */
+/* ---------------------------------------------------------------------- */
+
+static bool byTime(const Event& a, const Event& b)
+{
+  return a.at < b.at;
+}
+
+void schedule(const Event& event)
+{
+  timeline.insert(std::upper_bound(timeline.begin(), timeline.end(), event, byTime), event);
+}
+
+bool pending()
+{
+  return !timeline.empty() || !deferred.empty();
+}
+
+static void fireTwi(const Event& event)
+{
+  if (event.at < clockNs)
+  {
+    counters.twiDeferred++;
+    counters.twiDeferMaxNs = std::max(counters.twiDeferMaxNs, clockNs - event.at);
+  }
+  isr([&event]() {
+    dispatchEvent(event);
+  });
+}
+
+static void fireDue()
+{
+  if (adcDoneAt <= clockNs)
+  {
+    adcComplete();
+    adcInterrupt();
+  }
+
+  if (t1MatchAt <= clockNs)
+  {
+    timer1Match();
+    timer1Interrupt();
+  }
+
+  while (!timeline.empty() && (timeline.front().at <= clockNs))
+  {
+    Event event = timeline.front();
+
+    timeline.erase(timeline.begin());
+    if (event.kind == EVENT_MODEL) dispatchEvent(event);
+    else if (!globalIrq || !deferred.empty()) deferred.push_back(event);
+    else fireTwi(event);
+  }
+}
+
+static void runPendingInterrupts()
+{
+  adcInterrupt();
+  timer1Interrupt();
+
+  while (globalIrq && !deferred.empty())
+  {
+    Event event = deferred.front();
+
+    deferred.pop_front();
+    fireTwi(event);
+  }
+}
+}
+
+/* ---------------------------------------------------------------------- */
+/* Arduino core, TinyWireS and register objects                            */
+/* ---------------------------------------------------------------------- */
+
+SimRegister   ADMUX(sim::REG_ADMUX);
+SimRegister   ADCSRA(sim::REG_ADCSRA);
+SimRegister   ADCSRB(sim::REG_ADCSRB);
+SimRegister   ADCL(sim::REG_ADCL);
+SimRegister   ADCH(sim::REG_ADCH);
+SimRegister16 ADC(sim::REG_ADCL, sim::REG_ADCH);
+SimRegister   ACSR(sim::REG_ACSR);
+SimRegister   DIDR0(sim::REG_DIDR0);
+SimRegister   PRR(sim::REG_PRR);
+SimRegister   PORTB(sim::REG_PORTB);
+SimRegister   DDRB(sim::REG_DDRB);
+SimRegister   PINB(sim::REG_PINB);
+SimRegister   MCUCR(sim::REG_MCUCR);
+SimRegister   SREG(sim::REG_SREG);
+SimRegister   TCCR1(sim::REG_TCCR1);
+SimRegister   TCNT1(sim::REG_TCNT1);
+SimRegister   OCR1A(sim::REG_OCR1A);
+SimRegister   TIMSK(sim::REG_TIMSK);
+SimRegister   TIFR(sim::REG_TIFR);
+
+volatile uint8_t sim_port_token;
+USI_TWI_S TinyWireS;
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+  sim::pinMode(pin, mode);
+}
+
+void digitalWrite(uint8_t pin, uint8_t value)
+{
+  sim::digitalWrite(pin, value);
+}
+
+int digitalRead(uint8_t pin)
+{
+  return sim::digitalRead(pin);
+}
+
+int analogRead(uint8_t channel)
+{
+  return sim::analogRead(channel);
+}
+
+unsigned long millis(void)
+{
+  sim::cycles(30);
+  return sim::now() / 1000000ULL;
+}
+
+unsigned long micros(void)
+{
+  sim::cycles(40);
+  return sim::now() / 1000ULL;
+}
+
+void delay(unsigned long ms)
+{
+  sim::advance(ms * 1000000ULL);
+}
+
+void delayMicroseconds(unsigned int us)
+{
+  sim::advance(us * 1000ULL);
+}
+
+uint8_t sim_direct_read(volatile uint8_t *, uint8_t mask)
+{
+  return (sim::readRegister(sim::REG_PINB) & mask) ? 1 : 0;
+}
+
+void sim_direct_mode(volatile uint8_t *, uint8_t mask, uint8_t output)
+{
+  uint8_t ddr = sim::readRegister(sim::REG_DDRB);
+
+  sim::writeRegister(sim::REG_DDRB, output ? (ddr | mask) : (ddr & ~mask));
+}
+
+void sim_direct_write(volatile uint8_t *, uint8_t mask, uint8_t high)
+{
+  uint8_t port = sim::readRegister(sim::REG_PORTB);
+
+  sim::writeRegister(sim::REG_PORTB, high ? (port | mask) : (port & ~mask));
+}
+
+void TinyWireS_stop_check()
+{
+  sim::twiStopCheck();
+}
+
+// Same loop as the USI library: keep servicing the receive callback while
+// waiting, so deferred writes are handled within a few microseconds. The
+// cast keeps the 16 bit wrap-around AVR's int gives for free.
+void tws_delay(unsigned long ms)
+{
+  uint16_t start = (uint16_t)micros();
+
+  while (ms > 0)
+  {
+    TinyWireS_stop_check();
+    if ((uint16_t)((uint16_t)micros() - start) >= 1000)
+    {
+      ms--;
+      start += 1000;
+    }
+  }
+}
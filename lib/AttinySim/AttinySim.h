@@ -0,0 +1,153 @@
+/*!
+   \file AttinySim.h
+   \brief Host-side model of the ATtiny85 the firmware runs on.
+
+   The simulator keeps a virtual clock in nanoseconds. Everything that takes
+   time on the real part (delays, ADC conversions, EEPROM writes, register
+   spins, sleeping) advances that clock, and interrupt sources (the ADC, the
+   USI/TWI slave driven by a scripted master) fire from inside those advances
+   exactly like an ISR would, honouring cli()/sei().
+ */
+
+#ifndef AttinySim_h
+#define AttinySim_h
+
+#include <stdint.h>
+
+namespace sim
+{
+// clock
+uint64_t now();                  // virtual time in ns
+void     advance(uint64_t ns);   // let time pass, firing due events
+void     cycles(uint32_t count); // CPU cycles at F_CPU
+void     sleepUntilWake();       // SLEEP_MODE_IDLE: run to the next interrupt
+
+// interrupts
+bool interruptsEnabled();
+void setInterrupts(bool enabled);
+
+// register file, see avr/io.h
+enum Register
+{
+  REG_ADMUX,
+  REG_ADCSRA,
+  REG_ADCSRB,
+  REG_ADCL,
+  REG_ADCH,
+  REG_ACSR,
+  REG_DIDR0,
+  REG_PRR,
+  REG_PORTB,
+  REG_DDRB,
+  REG_PINB,
+  REG_MCUCR,
+  REG_SREG,
+  REG_TCCR1,
+  REG_TCNT1,
+  REG_OCR1A,
+  REG_TIMSK,
+  REG_TIFR,
+  REG_COUNT
+};
+
+uint8_t readRegister(uint8_t reg);
+void    writeRegister(uint8_t reg, uint8_t value);
+uint8_t peekRegister(uint8_t reg); // no side effects, no time
+
+// pins
+void    pinMode(uint8_t pin, uint8_t mode);
+void    digitalWrite(uint8_t pin, uint8_t value);
+uint8_t digitalRead(uint8_t pin);
+int     analogRead(uint8_t channel);
+
+// EEPROM
+uint8_t eepromRead(uint16_t address);
+void    eepromWrite(uint16_t address, uint8_t value);
+uint16_t eepromLength();
+void    eepromLoad(uint16_t address, uint8_t value); // preset before boot, costs nothing
+bool    eepromReady();                               // no write in progress
+
+// USI/TWI slave
+void    twiBegin(uint8_t address);
+void    twiOnReceive(void (*handler)(uint8_t));
+void    twiOnRequest(void (*handler)(void));
+void    twiSend(uint8_t data);
+uint8_t twiAvailable();
+uint8_t twiReceive();
+void    twiStopCheck();
+bool    twiMasterWrite(uint8_t address, const uint8_t *data, uint8_t length);
+bool    twiMasterRead(uint8_t address, uint8_t *data, uint8_t length);
+
+// analog front end and temperature probe models, see SimModel.cpp
+struct Model
+{
+  float    vcc;          // supply voltage
+  float    ec25;         // solution conductivity at 25 C, in the firmware's mS
+  float    alpha;        // solution temperature coefficient per C
+  float    cellK;        // true cell constant
+  float    waterC;       // water temperature
+  float    noiseLsb;     // ADC noise, RMS in LSB
+  float    cdl;          // electrode double layer capacitance in F, 0 disables polarisation
+  float    rf;           // electrode faradaic leakage resistance in ohm
+  float    ds18Scale;    // DS18B20 conversion time as a fraction of the datasheet maximum
+  uint8_t  ds18Count;    // number of DS18B20 on the bus
+  float    ds18C[8];     // per sensor temperature, NAN follows waterC
+};
+Model& model();
+
+void    modelReset();
+float   analogVoltage(uint8_t channel);  // voltage on an ADC input now
+void    electrodeUpdate();               // integrate polarisation up to now()
+void    oneWireEdge(bool masterLow);     // master changed its drive of DS18_PIN
+bool    oneWireLine();                   // bus level seen on DS18_PIN now
+void    oneWireReset();                  // rebuild the sensor population
+uint8_t crc8(const uint8_t *data, uint8_t len); // Dallas/Maxim CRC-8
+
+// statistics reported at the end of a run
+struct Stats
+{
+  uint64_t sleepNs;
+  uint64_t maskedMaxNs;
+  uint64_t isrMaxNs;
+  uint32_t twiTransactions;
+  uint32_t twiDeferred;
+  uint64_t twiDeferMaxNs;
+  uint32_t twiReceives;
+  uint64_t twiLatencySumNs;
+  uint64_t twiLatencyMaxNs;
+  uint32_t twiNacks;
+  uint32_t adcConversions;
+  uint32_t eepromWrites;
+  uint32_t oneWireSlots;
+  uint32_t oneWireViolations;
+};
+Stats& stats();
+uint32_t eepromWear(uint16_t address);
+
+// scripted master, see SimMain.cpp
+struct Event
+{
+  uint64_t at;
+  uint8_t  kind;
+  uint8_t  address;
+  uint8_t  length;
+  uint8_t  data[17];
+  uint8_t  format;
+  float    value;
+  float    tolerance;
+  uint32_t line;
+};
+
+enum EventKind
+{
+  EVENT_TWI_WRITE,
+  EVENT_TWI_READ,
+  EVENT_MODEL
+};
+
+void schedule(const Event& event);
+bool pending();
+void dispatchEvent(const Event& event); // implemented by the script runner
+}
+
+#endif // ifndef AttinySim_h
@@ -0,0 +1,58 @@
+/*!
+   \file EEPROM.h
+   \brief EEPROM library stand-in for the native build.
+
+   Mirrors the AVR core: put() only writes bytes that differ, and every
+   physical write keeps the next EEPROM access waiting ~3.4 ms.
+ */
+
+#ifndef EEPROM_h
+#define EEPROM_h
+
+#include <stdint.h>
+#include <AttinySim.h>
+#include <avr/eeprom.h>
+
+struct EEPROMClass
+{
+  uint8_t read(int idx)
+  {
+    return sim::eepromRead(idx);
+  }
+
+  void write(int idx, uint8_t val)
+  {
+    sim::eepromWrite(idx, val);
+  }
+
+  void update(int idx, uint8_t val)
+  {
+    if (read(idx) != val) write(idx, val);
+  }
+
+  uint16_t length()
+  {
+    return sim::eepromLength();
+  }
+
+  template<typename T>T& get(int idx, T& t)
+  {
+    uint8_t *ptr = (uint8_t *)&t;
+
+    for (unsigned int count = sizeof(T); count; --count, ++idx) *ptr++ = read(idx);
+    return t;
+  }
+
+  template<typename T>const T& put(int idx, const T& t)
+  {
+    const uint8_t *ptr = (const uint8_t *)&t;
+
+    for (unsigned int count = sizeof(T); count; --count, ++idx) update(idx, *ptr++);
+    return t;
+  }
+};
+
+// as in the AVR core, every file including this gets one, not all use it
+static EEPROMClass EEPROM __attribute__((unused));
+
+#endif // ifndef EEPROM_h
@@ -0,0 +1,404 @@
+/*!
+   \file SimMain.cpp
+   \brief Script runner for the native build.
+
+   Runs the firmware's setup() and loop() against the simulated ATtiny85
+   while an I2C master replays a script, then prints a timing summary.
+
+   Usage: program [script]   (reads stdin when no script is given)
+
+   Script lines, '#' starts a comment:
+     set <name> <value>          model parameter, see below
+     eeprom <address> <byte>...  preset EEPROM contents before boot
+     addr <address>              I2C address the master talks to (0x3C)
+     wait <ms>                   let the master idle
+     write <reg> <byte>...       write bytes starting at a register
+     writef <reg> <float>        write a float register
+     read <reg> <count>          read and print bytes
+     readf <reg>                 read and print a float register
+     expect <reg> <value> [tol]  read a float register, fail the run if off
+     expectb <reg> <byte>...     read bytes, fail the run if any differs
+     block <reg> <status> [n]    read the 15 byte results block, fail the
+                                 run on a bad CRC, another status or a
+                                 sequence that did not advance by n since
+                                 the last block line (by any if n is left
+                                 out)
+
+   Model parameters: vcc, ec (at 25 C), alpha, k (cell constant), temp
+   (water), noise (ADC LSB rms), cdl (uF, 0 = no polarisation), rf (ohm),
+   ds18scale (conversion time vs. datasheet), sensors (DS18B20 count) and
+   sensor0..sensor7 (per sensor temperature, nan follows the water).
+
+   set and eeprom lines before the first master command apply before boot,
+   everything else happens in order on the master's clock, which starts
+   when setup() returns.
+ */
+
+#include <Arduino.h>
+
+#include <stdio.h>
+#include <time.h>
+#include <vector>
+
+namespace
+{
+enum Format
+{
+  FORMAT_BYTES,
+  FORMAT_FLOAT,
+  FORMAT_EXPECT,
+  FORMAT_EXPECT_BYTES,
+  FORMAT_BLOCK
+};
+
+enum Parameter
+{
+  P_VCC,
+  P_EC,
+  P_ALPHA,
+  P_K,
+  P_TEMP,
+  P_NOISE,
+  P_CDL,
+  P_RF,
+  P_DS18SCALE,
+  P_SENSORS,
+  P_SENSOR0
+};
+
+const char *parameters[] = { "vcc", "ec", "alpha", "k", "temp", "noise", "cdl", "rf", "ds18scale", "sensors" };
+
+const uint64_t BYTE_NS = 90000; // 9 clocks at 100 kHz
+
+std::vector<sim::Event> script;
+uint32_t failures;
+uint8_t  address = 0x3C;
+int      sequence = -1; // of the last block line
+
+double ms(uint64_t ns)
+{
+  return ns / 1e6;
+}
+
+int parameter(const char *name)
+{
+  for (unsigned i = 0; i < sizeof(parameters) / sizeof(parameters[0]); i++)
+  {
+    if (!strcmp(name, parameters[i])) return i;
+  }
+  if (!strncmp(name, "sensor", 6) && (name[6] >= '0') && (name[6] <= '7') && !name[7]) return P_SENSOR0 + name[6] - '0';
+
+  return -1;
+}
+
+void apply(uint8_t which, float value)
+{
+  sim::Model& m = sim::model();
+
+  switch (which)
+  {
+  case P_VCC: m.vcc = value; break;
+  case P_EC: m.ec25 = value; break;
+  case P_ALPHA: m.alpha = value; break;
+  case P_K: m.cellK = value; break;
+  case P_TEMP: m.waterC = value; break;
+  case P_NOISE: m.noiseLsb = value; break;
+  case P_CDL: m.cdl = value * 1e-6f; break;
+  case P_RF: m.rf = value; break;
+  case P_DS18SCALE: m.ds18Scale = value; break;
+  case P_SENSORS:
+    m.ds18Count = (uint8_t)value;
+    sim::oneWireReset();
+    break;
+  default: m.ds18C[which - P_SENSOR0] = value;
+  }
+}
+
+bool fail(uint32_t line, const char *message)
+{
+  fprintf(stderr, "line %u: %s\n", line, message);
+  return false;
+}
+
+// Turn one script line into master events at 'at', advancing it by the
+// time the transaction keeps the bus busy.
+bool parse(char *text, uint32_t line, uint64_t& at, bool& booted)
+{
+  char *words[20];
+  int   count = 0;
+
+  if (char *comment = strchr(text, '#')) *comment = 0;
+  for (char *word = strtok(text, " \t\r\n"); word && count < 20; word = strtok(NULL, " \t\r\n")) words[count++] = word;
+  if (!count) return true;
+
+  sim::Event event;
+
+  memset(&event, 0, sizeof(event));
+  event.line    = line;
+  event.address = address;
+
+  const char *command = words[0];
+
+  if (!strcmp(command, "set") && (count == 3))
+  {
+    int which = parameter(words[1]);
+
+    if (which < 0) return fail(line, "unknown model parameter");
+
+    if (!booted)
+    {
+      apply(which, strtof(words[2], NULL));
+      return true;
+    }
+    event.kind    = sim::EVENT_MODEL;
+    event.data[0] = which;
+    event.value   = strtof(words[2], NULL);
+  }
+  else if (!strcmp(command, "eeprom") && (count >= 3) && !booted)
+  {
+    uint16_t base = strtol(words[1], NULL, 0);
+
+    for (int i = 2; i < count; i++) sim::eepromLoad(base + i - 2, strtol(words[i], NULL, 0));
+    return true;
+  }
+  else if (!strcmp(command, "addr") && (count == 2))
+  {
+    address = strtol(words[1], NULL, 0);
+    return true;
+  }
+  else if (!strcmp(command, "wait") && (count == 2))
+  {
+    booted = true;
+    at    += (uint64_t)(strtod(words[1], NULL) * 1e6);
+    return true;
+  }
+  else if ((!strcmp(command, "write") && (count >= 3) && (count <= 18)) ||
+           (!strcmp(command, "writef") && (count == 3)))
+  {
+    event.kind    = sim::EVENT_TWI_WRITE;
+    event.data[0] = strtol(words[1], NULL, 0);
+    if (command[5] == 'f')
+    {
+      float value = strtof(words[2], NULL);
+
+      memcpy(event.data + 1, &value, 4);
+      event.length = 5;
+    }
+    else
+    {
+      for (int i = 2; i < count; i++) event.data[i - 1] = strtol(words[i], NULL, 0);
+      event.length = count - 1;
+    }
+  }
+  else if ((!strcmp(command, "read") && (count == 3)) ||
+           (!strcmp(command, "readf") && (count == 2)) ||
+           (!strcmp(command, "expect") && ((count == 3) || (count == 4))) ||
+           (!strcmp(command, "expectb") && (count >= 3) && (count <= 18)) ||
+           (!strcmp(command, "block") && ((count == 3) || (count == 4))))
+  {
+    sim::Event select = event;
+
+    select.kind    = sim::EVENT_TWI_WRITE;
+    select.data[0] = strtol(words[1], NULL, 0);
+    select.length  = 1;
+    select.at      = at;
+    script.push_back(select);
+    at += 2 * BYTE_NS;
+
+    event.kind    = sim::EVENT_TWI_READ;
+    event.data[0] = select.data[0];
+    event.length  = 4;
+    event.format  = FORMAT_FLOAT;
+    if (!strcmp(command, "block"))
+    {
+      event.format  = FORMAT_BLOCK;
+      event.length  = 15;
+      event.data[1] = strtol(words[2], NULL, 0);
+      event.value   = (count == 4) ? strtof(words[3], NULL) : NAN;
+    }
+    else if (!strcmp(command, "expectb"))
+    {
+      event.format = FORMAT_EXPECT_BYTES;
+      event.length = count - 2;
+      for (int i = 2; i < count; i++) event.data[i - 1] = strtol(words[i], NULL, 0);
+    }
+    else if (command[0] == 'e')
+    {
+      event.format    = FORMAT_EXPECT;
+      event.value     = strtof(words[2], NULL);
+      event.tolerance = (count == 4) ? strtof(words[3], NULL) : 0.001f;
+    }
+    else if (command[4] != 'f')
+    {
+      event.format = FORMAT_BYTES;
+      event.length = strtol(words[2], NULL, 0);
+      if (event.length > 16) return fail(line, "at most 16 bytes per read");
+    }
+  }
+  else
+  {
+    return fail(line, "cannot parse");
+  }
+
+  booted   = true;
+  event.at = at;
+  script.push_back(event);
+  if (event.kind != sim::EVENT_MODEL) at += (1 + event.length) * BYTE_NS;
+  return true;
+}
+
+void report(const sim::Event& event, const uint8_t *data, bool acked)
+{
+  printf("%10.3f ms  ", ms(sim::now()));
+  if (!acked)
+  {
+    printf("line %u: 0x%02X NACK\n", event.line, event.address);
+    if (event.format >= FORMAT_EXPECT) failures++;
+    return;
+  }
+
+  float value;
+
+  memcpy(&value, data, 4);
+  switch (event.format)
+  {
+  case FORMAT_BYTES:
+    printf("read  %3u:", event.data[0]);
+    for (uint8_t i = 0; i < event.length; i++) printf(" %02x", data[i]);
+    printf("\n");
+    break;
+
+  case FORMAT_FLOAT:
+    printf("read  %3u: %g\n", event.data[0], value);
+    break;
+
+  case FORMAT_BLOCK:
+  {
+    uint8_t advance = data[1] - sequence;
+    bool    crcOk   = !sim::crc8(data, event.length);
+    bool    seqOk   = (sequence < 0) || (isnan(event.value) ? advance != 0 : advance == event.value);
+    bool    ok      = crcOk && seqOk && (data[0] == event.data[1]);
+
+    printf("block  %3u: status %02x, want %02x, sequence %u (+%u), crc %s  %s\n", event.data[0], data[0], event.data[1],
+           data[1], (sequence < 0) ? 0 : advance, crcOk ? "ok" : "bad", ok ? "ok" : "FAIL");
+    sequence = data[1];
+    if (!ok) failures++;
+    break;
+  }
+
+  case FORMAT_EXPECT_BYTES:
+  {
+    bool ok = !memcmp(data, event.data + 1, event.length);
+
+    printf("expect %3u:", event.data[0]);
+    for (uint8_t i = 0; i < event.length; i++) printf(" %02x", data[i]);
+    printf(", want");
+    for (uint8_t i = 0; i < event.length; i++) printf(" %02x", event.data[1 + i]);
+    printf("  %s\n", ok ? "ok" : "FAIL");
+    if (!ok) failures++;
+    break;
+  }
+
+  case FORMAT_EXPECT:
+    bool ok = (isnan(event.value) && isnan(value)) || (fabsf(value - event.value) <= event.tolerance);
+
+    printf("expect %3u: %g, want %g +/- %g  %s\n", event.data[0], value, event.value, event.tolerance, ok ? "ok" : "FAIL");
+    if (!ok) failures++;
+    break;
+  }
+}
+
+void summary(uint32_t iterations, double hostSeconds)
+{
+  const sim::Stats& s = sim::stats();
+  uint32_t wear = 0, wearAt = 0;
+
+  for (uint16_t i = 0; i < sim::eepromLength(); i++)
+  {
+    if (sim::eepromWear(i) > wear)
+    {
+      wear   = sim::eepromWear(i);
+      wearAt = i;
+    }
+  }
+
+  printf("---\n");
+  printf("virtual time        %10.3f ms (host %.3f s)\n", ms(sim::now()), hostSeconds);
+  printf("loop() iterations   %10u, asleep %.1f %%\n", iterations, sim::now() ? 100.0 * s.sleepNs / sim::now() : 0);
+  printf("i2c transactions    %10u, %u nack, %u stalled (max %.3f ms)\n", s.twiTransactions, s.twiNacks, s.twiDeferred, ms(s.twiDeferMaxNs));
+  printf("i2c write handling  %10.3f ms mean, %.3f ms max\n", s.twiReceives ? ms(s.twiLatencySumNs / s.twiReceives) : 0, ms(s.twiLatencyMaxNs));
+  printf("interrupts masked   %10.3f ms max\n", ms(s.maskedMaxNs));
+  printf("interrupt handlers  %10.3f ms max\n", ms(s.isrMaxNs));
+  printf("adc conversions     %10u\n", s.adcConversions);
+  printf("eeprom bytes written%10u, most worn cell %u (%u writes)\n", s.eepromWrites, wearAt, wear);
+  printf("onewire slots       %10u, %u timing violations\n", s.oneWireSlots, s.oneWireViolations);
+  printf("expect failures     %10u\n", failures);
+}
+}
+
+namespace sim
+{
+void dispatchEvent(const Event& event)
+{
+  uint8_t data[16];
+
+  switch (event.kind)
+  {
+  case EVENT_MODEL:
+    apply(event.data[0], event.value);
+    return;
+
+  case EVENT_TWI_WRITE:
+    if (!twiMasterWrite(event.address, event.data, event.length)) report(event, data, false);
+    return;
+
+  case EVENT_TWI_READ:
+    report(event, data, twiMasterRead(event.address, data, event.length));
+    return;
+  }
+}
+}
+
+int main(int argc, char **argv)
+{
+  FILE *in = (argc > 1) ? fopen(argv[1], "r") : stdin;
+
+  if (!in)
+  {
+    perror(argv[1]);
+    return 2;
+  }
+
+  char     text[256];
+  uint32_t line   = 0;
+  uint64_t at     = 0;
+  bool     booted = false;
+
+  while (fgets(text, sizeof(text), in))
+  {
+    if (!parse(text, ++line, at, booted)) return 2;
+  }
+  if (in != stdin) fclose(in);
+
+  clock_t  started    = clock();
+  uint32_t iterations = 0;
+
+  setup();
+
+  uint64_t base = sim::now();
+
+  for (size_t i = 0; i < script.size(); i++)
+  {
+    script[i].at += base;
+    sim::schedule(script[i]);
+  }
+
+  while ((sim::now() < base + at) || sim::pending())
+  {
+    loop();
+    iterations++;
+  }
+
+  summary(iterations, (double)(clock() - started) / CLOCKS_PER_SEC);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,490 @@
+/*!
+   \file SimModel.cpp
+   \brief Electrode and DS18B20 models behind the simulated pins.
+
+   The conductivity cell sits between EC_PIN and SINK with the 500 ohm
+   series resistor between POWER_PIN and EC_PIN, so with POWER_PIN high and
+   SINK low the firmware's divider formula inverts exactly. Optionally the
+   electrodes polarise: a double layer capacitance with a faradaic leakage in
+   series with the solution resistance.
+
+   The DS18B20s are modelled at the slot level from the edges the master
+   drives on DS18_PIN, so OneWire timing mistakes show up as bad data and are
+   counted as violations.
+ */
+
+#include <Arduino.h>
+
+// probe board wiring, see main.h
+#define EC_PIN_SIM    PB3
+#define POWER_PIN_SIM PB1
+#define SINK_SIM      PB4
+
+namespace sim
+{
+static const float SERIES_RESISTOR = 500;
+
+static Model defaults()
+{
+  Model m;
+
+  m.vcc       = 5.0f;
+  m.ec25      = 1.413f;
+  m.alpha     = 0.02f;
+  m.cellK     = 1.0f;
+  m.waterC    = 25.0f;
+  m.noiseLsb  = 0.5f;
+  m.cdl       = 0;
+  m.rf        = 1000.0f;
+  m.ds18Scale = 1.0f;
+  m.ds18Count = 1;
+  for (uint8_t i = 0; i < 8; i++) m.ds18C[i] = NAN;
+  return m;
+}
+
+Model& model()
+{
+  static Model m = defaults();
+
+  return m;
+}
+
+void modelReset()
+{
+  model() = defaults();
+  oneWireReset();
+}
+
+/* ---------------------------------------------------------------------- */
+/* Conductivity cell                                                       */
+/* ---------------------------------------------------------------------- */
+
+static uint64_t electrodeAt;
+static float    polarisation;
+
+static float cellResistance()
+{
+  const Model& m = model();
+  float ec = m.ec25 * (1 + m.alpha * (m.waterC - 25));
+
+  if (ec <= 0) return 1e12f;
+
+  return 100000 * m.cellK / ec;
+}
+
+static bool driven(uint8_t pin)
+{
+  return peekRegister(REG_DDRB) & _BV(pin);
+}
+
+static float level(uint8_t pin)
+{
+  return (peekRegister(REG_PORTB) & _BV(pin)) ? model().vcc : 0;
+}
+
+void electrodeUpdate()
+{
+  const Model& m = model();
+  double dt      = (now() - electrodeAt) * 1e-9;
+
+  electrodeAt = now();
+  if (m.cdl <= 0)
+  {
+    polarisation = 0;
+    return;
+  }
+  if (dt <= 0) return;
+
+  // d(pol)/dt = a - b * pol, integrated exactly over a constant pin state
+  double b = 1 / (m.rf * m.cdl);
+  double a = 0;
+
+  if (driven(POWER_PIN_SIM) && driven(SINK_SIM))
+  {
+    double loop = (SERIES_RESISTOR + cellResistance()) * m.cdl;
+
+    a += (level(POWER_PIN_SIM) - level(SINK_SIM)) / loop;
+    b += 1 / loop;
+  }
+
+  double settled = a / b;
+
+  polarisation = settled + (polarisation - settled) * exp(-b * dt);
+}
+
+static float electrodeVoltage()
+{
+  float r = cellResistance();
+  float v;
+
+  electrodeUpdate();
+  if (driven(POWER_PIN_SIM) && driven(SINK_SIM))
+  {
+    float current = (level(POWER_PIN_SIM) - level(SINK_SIM) - polarisation) / (SERIES_RESISTOR + r);
+
+    v = level(POWER_PIN_SIM) - current * SERIES_RESISTOR;
+  }
+  else if (driven(POWER_PIN_SIM))
+  {
+    v = level(POWER_PIN_SIM);
+  }
+  else if (driven(SINK_SIM))
+  {
+    v = level(SINK_SIM) + polarisation;
+  }
+  else
+  {
+    v = polarisation;
+  }
+
+  if (v < 0) return 0;
+
+  return (v > model().vcc) ? model().vcc : v;
+}
+
+float analogVoltage(uint8_t channel)
+{
+  static const uint8_t pin[] = { PB5, PB2, PB4, PB3 };
+
+  switch (channel)
+  {
+  case 0x0C:
+    return 1.1f; // bandgap
+
+  case 0x0D:
+    return 0;    // GND
+
+  case 0x0F:
+    return 0.3f; // temperature sensor, roughly 25 C
+  }
+  if (channel > 3) return 0;
+
+  if (pin[channel] == EC_PIN_SIM) return electrodeVoltage();
+
+  if (driven(pin[channel])) return level(pin[channel]);
+
+  return 0;
+}
+
+/* ---------------------------------------------------------------------- */
+/* DS18B20 bus                                                             */
+/* ---------------------------------------------------------------------- */
+
+enum SensorState
+{
+  S_IDLE,
+  S_ROM,
+  S_MATCH,
+  S_SEARCH,
+  S_FUNCTION,
+  S_TX,
+  S_WRITE_SCRATCH,
+  S_CONVERT
+};
+
+struct Sensor
+{
+  uint8_t  rom[8];
+  uint8_t  scratch[9];
+  uint8_t  saved[3];
+  uint8_t  state;
+  uint8_t  bits;
+  uint8_t  bytes;
+  uint8_t  shift;
+  uint8_t  phase;
+  uint8_t  tx[9];
+  uint8_t  txLength;
+  uint64_t convDoneAt;
+  uint64_t pullFrom, pullUntil;
+};
+
+static const uint64_t US = 1000;
+
+static Sensor   sensors[8];
+static uint8_t  sensorCount;
+static bool     populated;
+static bool     masterIsLow;
+static uint64_t fallAt;
+static uint64_t riseAt;
+static bool     readSlot;
+
+uint8_t crc8(const uint8_t *data, uint8_t len)
+{
+  uint8_t crc = 0;
+
+  while (len--)
+  {
+    uint8_t in = *data++;
+
+    for (uint8_t i = 8; i; i--)
+    {
+      uint8_t mix = (crc ^ in) & 0x01;
+
+      crc >>= 1;
+      if (mix) crc ^= 0x8C;
+      in >>= 1;
+    }
+  }
+  return crc;
+}
+
+void oneWireReset()
+{
+  static const uint8_t scratch[] = { 0x50, 0x05, 0x4B, 0x46, 0x7F, 0xFF, 0x0C, 0x10 };
+  uint32_t serial = 0x1E64A2C5;
+
+  sensorCount = model().ds18Count > 8 ? 8 : model().ds18Count;
+  for (uint8_t i = 0; i < sensorCount; i++)
+  {
+    Sensor& s = sensors[i];
+
+    memset(&s, 0, sizeof(s));
+    s.rom[0] = 0x28;
+    for (uint8_t b = 1; b < 7; b++)
+    {
+      serial   = serial * 1103515245UL + 12345UL;
+      s.rom[b] = serial >> 16;
+    }
+    s.rom[7] = crc8(s.rom, 7);
+    memcpy(s.scratch, scratch, sizeof(scratch));
+    s.scratch[8] = crc8(s.scratch, 8);
+    memcpy(s.saved, s.scratch + 2, 3);
+  }
+  populated = true;
+}
+
+static uint8_t resolutionBits(const Sensor& s)
+{
+  return 9 + ((s.scratch[4] >> 5) & 0x03);
+}
+
+static void finishConversion(Sensor& s, uint8_t index)
+{
+  if (!s.convDoneAt || (now() < s.convDoneAt)) return;
+
+  float   c   = isnan(model().ds18C[index]) ? model().waterC : model().ds18C[index];
+  int16_t raw = (int16_t)lroundf(c * 16);
+
+  raw         &= ~((1 << (12 - resolutionBits(s))) - 1);
+  s.scratch[0] = raw & 0xFF;
+  s.scratch[1] = (raw >> 8) & 0xFF;
+  s.scratch[8] = crc8(s.scratch, 8);
+  s.convDoneAt = 0;
+}
+
+static bool shiftIn(Sensor& s, uint8_t bit)
+{
+  s.shift = (s.shift >> 1) | (bit << 7);
+  if (++s.bits < 8) return false;
+
+  s.bits = 0;
+  return true;
+}
+
+static uint8_t romBit(const Sensor& s)
+{
+  return (s.rom[s.bits >> 3] >> (s.bits & 7)) & 1;
+}
+
+static void transmit(Sensor& s, const uint8_t *data, uint8_t length)
+{
+  memcpy(s.tx, data, length);
+  s.txLength = length;
+  s.bits     = 0;
+  s.bytes    = 0;
+  s.state    = S_TX;
+}
+
+// -1 when the sensor is listening, otherwise the bit it puts on the bus
+static int8_t sending(const Sensor& s)
+{
+  switch (s.state)
+  {
+  case S_TX:
+    return (s.bytes < s.txLength) ? ((s.tx[s.bytes] >> s.bits) & 1) : 1;
+
+  case S_SEARCH:
+    if (s.phase == 2) return -1;
+
+    return s.phase ? !romBit(s) : romBit(s);
+
+  case S_CONVERT:
+    return s.convDoneAt ? 0 : 1;
+  }
+  return -1;
+}
+
+static void romCommand(Sensor& s, uint8_t command)
+{
+  s.bytes = 0;
+  s.bits  = 0;
+  s.phase = 0;
+  switch (command)
+  {
+  case 0x33: // read ROM
+    transmit(s, s.rom, 8);
+    return;
+
+  case 0x55: // match ROM
+    s.state = S_MATCH;
+    return;
+
+  case 0xCC: // skip ROM
+    s.state = S_FUNCTION;
+    return;
+
+  case 0xF0: // search ROM
+    s.state = S_SEARCH;
+    return;
+  }
+  s.state = S_IDLE; // alarm search never matches, nothing else is supported
+}
+
+static void functionCommand(Sensor& s, uint8_t command)
+{
+  s.bytes = 0;
+  s.bits  = 0;
+  switch (command)
+  {
+  case 0x44: // convert T
+    s.convDoneAt = now() + (uint64_t)(93750 * US * model().ds18Scale) * (1 << (resolutionBits(s) - 9));
+    s.state      = S_CONVERT;
+    return;
+
+  case 0xBE: // read scratchpad
+    s.scratch[8] = crc8(s.scratch, 8);
+    transmit(s, s.scratch, 9);
+    return;
+
+  case 0x4E: // write scratchpad
+    s.state = S_WRITE_SCRATCH;
+    return;
+
+  case 0x48: // copy scratchpad
+    memcpy(s.saved, s.scratch + 2, 3);
+    break;
+
+  case 0xB8: // recall EEPROM
+    memcpy(s.scratch + 2, s.saved, 3);
+    break;
+  }
+  s.state = S_IDLE; // read power supply answers 1 (external power) by not pulling
+}
+
+static void receiveBit(Sensor& s, uint8_t bit)
+{
+  switch (s.state)
+  {
+  case S_ROM:
+    if (shiftIn(s, bit)) romCommand(s, s.shift);
+    return;
+
+  case S_MATCH:
+    if (!shiftIn(s, bit)) return;
+
+    if (s.shift != s.rom[s.bytes]) s.state = S_IDLE;
+    else if (++s.bytes == 8) s.state = S_FUNCTION;
+    return;
+
+  case S_SEARCH:
+    if (s.phase < 2)
+    {
+      s.phase++;
+      return;
+    }
+    s.phase = 0;
+    if (bit != romBit(s)) s.state = S_IDLE;
+    else if (++s.bits == 64) s.state = S_FUNCTION;
+    return;
+
+  case S_FUNCTION:
+    if (shiftIn(s, bit)) functionCommand(s, s.shift);
+    return;
+
+  case S_TX:
+    if (++s.bits < 8) return;
+
+    s.bits = 0;
+    s.bytes++;
+    return;
+
+  case S_WRITE_SCRATCH:
+    if (!shiftIn(s, bit)) return;
+
+    s.scratch[2 + s.bytes] = s.shift;
+    if (++s.bytes == 3) s.state = S_IDLE;
+    return;
+  }
+}
+
+void oneWireEdge(bool masterLow)
+{
+  uint64_t t = now();
+
+  if (!populated) oneWireReset();
+  masterIsLow = masterLow;
+  for (uint8_t i = 0; i < sensorCount; i++) finishConversion(sensors[i], i);
+
+  if (masterLow)
+  {
+    fallAt   = t;
+    readSlot = false;
+    if (riseAt && (t - riseAt < 1 * US)) stats().oneWireViolations++; // recovery time
+    for (uint8_t i = 0; i < sensorCount; i++)
+    {
+      Sensor& s = sensors[i];
+
+      if (sending(s) != 0) continue;
+
+      s.pullFrom  = t;
+      s.pullUntil = t + 30 * US;
+    }
+    return;
+  }
+
+  uint64_t low = t - fallAt;
+
+  riseAt = t;
+  if (low >= 480 * US)
+  {
+    for (uint8_t i = 0; i < sensorCount; i++)
+    {
+      Sensor& s = sensors[i];
+
+      s.state     = S_ROM;
+      s.bits      = 0;
+      s.bytes     = 0;
+      s.pullFrom  = t + 30 * US;
+      s.pullUntil = t + 150 * US;
+    }
+    return;
+  }
+
+  stats().oneWireSlots++;
+
+  // slaves sample 15..60 us after the falling edge, typically at 30 us
+  if (((low > 15 * US) && (low < 60 * US)) || (low > 120 * US)) stats().oneWireViolations++;
+  uint8_t bit = low < 30 * US;
+
+  readSlot = bit;
+  for (uint8_t i = 0; i < sensorCount; i++) receiveBit(sensors[i], bit);
+}
+
+bool oneWireLine()
+{
+  uint64_t t = now();
+
+  if (masterIsLow) return false;
+
+  if (readSlot && (t - fallAt > 15 * US) && (t - fallAt < 60 * US))
+  {
+    stats().oneWireViolations++; // sampled after the slave may have released
+    readSlot = false;
+  }
+  for (uint8_t i = 0; i < sensorCount; i++)
+  {
+    if ((sensors[i].pullFrom <= t) && (t < sensors[i].pullUntil)) return false;
+  }
+  return true;
+}
+}
@@ -0,0 +1,59 @@
+/*!
+   \file TinyWireS.h
+   \brief TinyWireS stand-in for the native build.
+
+   Same surface as the USI slave library: onRequest runs from the simulated
+   USI interrupt for every byte the master clocks out, onReceive runs from
+   TinyWireS_stop_check() or from the next start condition.
+ */
+
+#ifndef TinyWireS_h
+#define TinyWireS_h
+
+#include <stdint.h>
+#include <AttinySim.h>
+
+#define TWI_RX_BUFFER_SIZE (16)
+#define TWI_TX_BUFFER_SIZE (16)
+
+class USI_TWI_S
+{
+public:
+
+  void begin(uint8_t I2C_SLAVE_ADDR)
+  {
+    sim::twiBegin(I2C_SLAVE_ADDR);
+  }
+
+  void send(uint8_t data)
+  {
+    sim::twiSend(data);
+  }
+
+  uint8_t available()
+  {
+    return sim::twiAvailable();
+  }
+
+  uint8_t receive()
+  {
+    return sim::twiReceive();
+  }
+
+  void onReceive(void (*function)(uint8_t))
+  {
+    sim::twiOnReceive(function);
+  }
+
+  void onRequest(void (*function)(void))
+  {
+    sim::twiOnRequest(function);
+  }
+};
+
+void TinyWireS_stop_check();
+void tws_delay(unsigned long ms);
+
+extern USI_TWI_S TinyWireS;
+
+#endif // ifndef TinyWireS_h
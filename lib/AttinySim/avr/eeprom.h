@@ -0,0 +1,16 @@
+/*!
+   \file eeprom.h
+   \brief EEPROM status for the native build.
+
+   The byte accessors live in EEPROM.h; only the ready check the firmware
+   polls before starting a write is provided here.
+ */
+
+#ifndef _AVR_EEPROM_H_
+#define _AVR_EEPROM_H_
+
+#include <AttinySim.h>
+
+#define eeprom_is_ready() sim::eepromReady()
+
+#endif // ifndef _AVR_EEPROM_H_
@@ -0,0 +1,22 @@
+/*!
+   \file interrupt.h
+   \brief Interrupt control for the native build.
+
+   ISR() bodies become plain functions that the simulator calls when the
+   matching source fires with interrupts enabled.
+ */
+
+#ifndef _AVR_INTERRUPT_H_
+#define _AVR_INTERRUPT_H_
+
+#include <AttinySim.h>
+
+#define sei() sim::setInterrupts(true)
+#define cli() sim::setInterrupts(false)
+
+#define ISR(vector, ...) extern "C" void vector(void)
+
+extern "C" void ADC_vect(void) __attribute__((weak));
+extern "C" void TIMER1_COMPA_vect(void) __attribute__((weak));
+
+#endif // ifndef _AVR_INTERRUPT_H_
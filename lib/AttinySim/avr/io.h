@@ -0,0 +1,206 @@
+/*!
+   \file io.h
+   \brief ATtiny85 register file for the native build.
+
+   Registers are small proxy objects so reads and writes reach the
+   simulator; bit positions match avr-libc's iotnx5.h.
+ */
+
+#ifndef _AVR_IO_H_
+#define _AVR_IO_H_
+
+#include <stdint.h>
+#include <AttinySim.h>
+
+class SimRegister
+{
+public:
+
+  explicit SimRegister(uint8_t id) : _id(id) {}
+
+  operator uint8_t() const
+  {
+    return sim::readRegister(_id);
+  }
+
+  SimRegister& operator=(int value)
+  {
+    sim::writeRegister(_id, (uint8_t)value);
+    return *this;
+  }
+
+  SimRegister& operator=(const SimRegister& other)
+  {
+    sim::writeRegister(_id, (uint8_t)other);
+    return *this;
+  }
+
+  SimRegister& operator|=(int value)
+  {
+    sim::writeRegister(_id, (uint8_t)(sim::readRegister(_id) | value));
+    return *this;
+  }
+
+  SimRegister& operator&=(int value)
+  {
+    sim::writeRegister(_id, (uint8_t)(sim::readRegister(_id) & value));
+    return *this;
+  }
+
+  SimRegister& operator^=(int value)
+  {
+    sim::writeRegister(_id, (uint8_t)(sim::readRegister(_id) ^ value));
+    return *this;
+  }
+
+private:
+
+  uint8_t _id;
+};
+
+class SimRegister16
+{
+public:
+
+  SimRegister16(uint8_t low, uint8_t high) : _low(low), _high(high) {}
+
+  operator uint16_t() const
+  {
+    uint8_t low = sim::readRegister(_low);
+
+    return low | (sim::readRegister(_high) << 8);
+  }
+
+private:
+
+  uint8_t _low, _high;
+};
+
+extern SimRegister   ADMUX;
+extern SimRegister   ADCSRA;
+extern SimRegister   ADCSRB;
+extern SimRegister   ADCL;
+extern SimRegister   ADCH;
+extern SimRegister16 ADC;
+extern SimRegister   ACSR;
+extern SimRegister   DIDR0;
+extern SimRegister   PRR;
+extern SimRegister   PORTB;
+extern SimRegister   DDRB;
+extern SimRegister   PINB;
+extern SimRegister   MCUCR;
+extern SimRegister   SREG;
+extern SimRegister   TCCR1;
+extern SimRegister   TCNT1;
+extern SimRegister   OCR1A;
+extern SimRegister   TIMSK;
+extern SimRegister   TIFR;
+
+#define ADCW ADC
+
+#ifndef _BV
+# define _BV(bit) (1 << (bit))
+#endif // ifndef _BV
+#define _SFR_BYTE(sfr)          (sfr)
+#define bit_is_set(sfr, bit)    ((uint8_t)(sfr) & _BV(bit))
+#define bit_is_clear(sfr, bit)  (!((uint8_t)(sfr) & _BV(bit)))
+#define loop_until_bit_is_set(sfr, bit)   do {} while (bit_is_clear(sfr, bit))
+#define loop_until_bit_is_clear(sfr, bit) do {} while (bit_is_set(sfr, bit))
+
+// ADMUX
+#define REFS1 7
+#define REFS0 6
+#define ADLAR 5
+#define REFS2 4
+#define MUX3  3
+#define MUX2  2
+#define MUX1  1
+#define MUX0  0
+
+// ADCSRA
+#define ADEN  7
+#define ADSC  6
+#define ADATE 5
+#define ADIF  4
+#define ADIE  3
+#define ADPS2 2
+#define ADPS1 1
+#define ADPS0 0
+
+// ADCSRB
+#define BIN   7
+#define ACME  6
+#define IPR   5
+#define ADTS2 2
+#define ADTS1 1
+#define ADTS0 0
+
+// ACSR
+#define ACD   7
+#define ACBG  6
+#define ACO   5
+#define ACI   4
+#define ACIE  3
+#define ACIS1 1
+#define ACIS0 0
+
+// DIDR0
+#define ADC0D 5
+#define ADC2D 4
+#define ADC3D 3
+#define ADC1D 2
+#define AIN1D 1
+#define AIN0D 0
+
+// PRR
+#define PRTIM1 3
+#define PRTIM0 2
+#define PRUSI  1
+#define PRADC  0
+
+// TCCR1, only normal mode is modelled
+#define CTC1   7
+#define PWM1A  6
+#define COM1A1 5
+#define COM1A0 4
+#define CS13   3
+#define CS12   2
+#define CS11   1
+#define CS10   0
+
+// TIMSK
+#define OCIE1A 6
+#define OCIE1B 5
+#define OCIE0A 4
+#define OCIE0B 3
+#define TOIE1  2
+#define TOIE0  1
+
+// TIFR
+#define OCF1A 6
+#define OCF1B 5
+#define OCF0A 4
+#define OCF0B 3
+#define TOV1  2
+#define TOV0  1
+
+// MCUCR
+#define BODS  7
+#define PUD   6
+#define SE    5
+#define SM1   4
+#define SM0   3
+#define BODSE 2
+
+// PORTB
+#define PB5 5
+#define PB4 4
+#define PB3 3
+#define PB2 2
+#define PB1 1
+#define PB0 0
+
+#define E2END 0x1FF
+#define RAMEND 0x25F
+
+#endif // ifndef _AVR_IO_H_
@@ -0,0 +1,22 @@
+/*!
+   \file pgmspace.h
+   \brief Flash accessors for the native build, where flash is plain memory.
+ */
+
+#ifndef _AVR_PGMSPACE_H_
+#define _AVR_PGMSPACE_H_
+
+#include <stdint.h>
+#include <string.h>
+
+#define PROGMEM
+#define PSTR(s) (s)
+
+#define pgm_read_byte(address)  (*(const uint8_t *)(address))
+#define pgm_read_word(address)  (*(const uint16_t *)(address))
+#define pgm_read_dword(address) (*(const uint32_t *)(address))
+#define pgm_read_float(address) (*(const float *)(address))
+#define pgm_read_ptr(address)   (*(void *const *)(address))
+#define memcpy_P(dest, src, n)  memcpy((dest), (src), (n))
+
+#endif // ifndef _AVR_PGMSPACE_H_
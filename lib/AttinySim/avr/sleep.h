@@ -0,0 +1,24 @@
+/*!
+   \file sleep.h
+   \brief Sleep control for the native build.
+
+   Any sleep mode is treated as idle: the simulated CPU resumes on the next
+   interrupt or timer0 overflow, whichever comes first.
+ */
+
+#ifndef _AVR_SLEEP_H_
+#define _AVR_SLEEP_H_
+
+#include <avr/io.h>
+
+#define SLEEP_MODE_IDLE     (0)
+#define SLEEP_MODE_ADC      _BV(SM0)
+#define SLEEP_MODE_PWR_DOWN _BV(SM1)
+
+#define set_sleep_mode(mode) (MCUCR = (uint8_t)((MCUCR & ~(_BV(SM0) | _BV(SM1))) | (mode)))
+#define sleep_enable()       (MCUCR |= _BV(SE))
+#define sleep_disable()      (MCUCR &= (uint8_t) ~_BV(SE))
+#define sleep_cpu()          do { if (MCUCR & _BV(SE)) sim::sleepUntilWake(); } while (0)
+#define sleep_mode()         do { sleep_enable(); sleep_cpu(); sleep_disable(); } while (0)
+
+#endif // ifndef _AVR_SLEEP_H_
@@ -135,9 +135,7 @@ bool DallasTemperature::readScratchPad(const uint8_t* deviceAddress, uint8_t* sc
     // byte 7: DS18S20: COUNT_PER_C
     //         DS18B20 & DS1822: store for crc
     // byte 8: SCRATCHPAD_CRC
-    for(uint8_t i = 0; i < 9; i++){
-        scratchPad[i] = _wire->read();
-    }
+    _wire->read_bytes(scratchPad, 9);
 
     b = _wire->reset();
     return (b == 1);
@@ -136,6 +136,7 @@ OneWire::OneWire(uint8_t pin)
 
 static uint8_t busFailFlag; 	// Set to one if bus failed to return to high via pull-up
 
+#if !ONEWIRE_TIMER1
 // Perform the onewire reset function.  1=Ok to proceed, 0=no devices found or possible short to ground on bus
 
 // First we will send a reset pulse and see if any slaves send back
@@ -195,6 +196,7 @@ uint8_t OneWire::reset(void)
 	// Leave the pin in pull-up mode after reset
 
 }
+#endif
 
 // Only valid after a call to reset() that returned 0.
 // Returns 1 if the bus did not float to
@@ -208,6 +210,7 @@ uint8_t OneWire::busFail() {
 	return busFailFlag;
 }
 
+#if !ONEWIRE_TIMER1
 //
 // Write a bit. Port and bit is used to cut lookup time and provide
 // more certain timing.
@@ -315,17 +318,237 @@ void OneWire::read_bytes(uint8_t *buf, uint16_t count) {
   for (uint16_t i = 0 ; i < count ; i++)
     buf[i] = read();
 }
+#endif
+
+#if ONEWIRE_TIMER1
+//
+// Timer1 driven slots. Compare match A moves a small state machine on,
+// one timer count per microsecond, while the caller spins with
+// interrupts enabled.  Only what has to be exact to the microsecond
+// happens inside the handler: a 1 bit's low pulse and a read slot up to
+// its sample, at most 13us.  A 0 bit's 65us low, the reset's 480us low
+// and every gap between slots are timed by the compare instead of by
+// delays with interrupts masked.  Each step is scheduled from the
+// counter after the edge, so an interrupt arriving late only stretches
+// a slot, it never shortens one.
+//
+
+#if !defined(__AVR_ATtiny85__)
+#error "ONEWIRE_TIMER1 uses the ATtiny85's Timer1"
+#endif
+
+#if F_CPU == 16000000L
+#define ONEWIRE_T1_CLOCK (_BV(CS12) | _BV(CS10)) // CK/16
+#elif F_CPU == 8000000L
+#define ONEWIRE_T1_CLOCK _BV(CS12)               // CK/8
+#elif F_CPU == 1000000L
+#define ONEWIRE_T1_CLOCK _BV(CS10)               // CK/1
+#else
+#error "ONEWIRE_TIMER1 needs a 1, 8 or 16 MHz clock"
+#endif
+
+enum {
+	T1_RESET_LOW,      // second half of the 480us reset pulse
+	T1_RESET_RELEASE,  // let the slaves answer
+	T1_RESET_PRESENCE, // sample their presence pulse
+	T1_RESET_RECOVER,  // first half of the 410us wait for it to end
+	T1_RESET_DONE,     // check that the bus came back up
+	T1_SLOT,           // start the next slot, or stop
+	T1_WRITE0_DONE     // end a 0 bit's low pulse
+};
+
+static volatile uint8_t t1State;
+static volatile uint8_t t1Slots;    // slots still to run in this byte
+static volatile uint8_t t1Data;     // written from bit 0, read into bit 7
+static volatile uint16_t t1Bytes;   // bytes still to come from or go to t1Buffer
+static uint8_t *t1Buffer;
+static volatile uint8_t t1Reading;
+static volatile uint8_t t1Presence;
+static volatile uint8_t t1BusHigh;
+static IO_REG_TYPE t1Mask;
+static volatile IO_REG_TYPE *t1Reg;
+
+static inline void t1Next(uint8_t state, uint8_t us)
+{
+	t1State = state;
+	OCR1A = TCNT1 + us;
+}
+
+ISR(TIMER1_COMPA_vect)
+{
+	IO_REG_TYPE mask = t1Mask;
+	volatile IO_REG_TYPE *reg = t1Reg;
+
+	switch (t1State) {
+	case T1_RESET_LOW:
+		t1Next(T1_RESET_RELEASE, 240);
+		return;
+
+	case T1_RESET_RELEASE:
+		DIRECT_MODE_INPUT(reg, mask);
+		DIRECT_WRITE_HIGH(reg, mask);
+		t1Next(T1_RESET_PRESENCE, 70);
+		return;
+
+	case T1_RESET_PRESENCE:
+		t1Presence = !DIRECT_READ(reg, mask);
+		t1Next(T1_RESET_RECOVER, 205);
+		return;
+
+	case T1_RESET_RECOVER:
+		t1Next(T1_RESET_DONE, 205);
+		return;
+
+	case T1_RESET_DONE:
+		t1BusHigh = DIRECT_READ(reg, mask);
+		TIMSK &= ~_BV(OCIE1A);
+		return;
+
+	case T1_SLOT:
+		if (!t1Slots) {
+			if (!t1Bytes) {
+				TIMSK &= ~_BV(OCIE1A);
+				return;
+			}
+
+			// the next byte of a buffer goes out without stopping the timer
+			if (t1Reading) *t1Buffer++ = t1Data;
+			else t1Data = *t1Buffer++;
+			t1Bytes--;
+			t1Slots = 8;
+		}
+		t1Slots--;
+
+		DIRECT_WRITE_LOW(reg, mask);
+		DIRECT_MODE_OUTPUT(reg, mask);
+		if (t1Reading) {
+			delayMicroseconds(3);
+			DIRECT_MODE_INPUT(reg, mask);
+			DIRECT_WRITE_HIGH(reg, mask);
+			delayMicroseconds(10);
+			t1Data = (t1Data >> 1) | (DIRECT_READ(reg, mask) << 7);
+			t1Next(T1_SLOT, 53);
+		} else if (t1Data & 1) {
+			delayMicroseconds(10);
+			DIRECT_WRITE_HIGH(reg, mask);
+			t1Data >>= 1;
+			t1Next(T1_SLOT, 55);
+		} else {
+			t1Data >>= 1;
+			t1Next(T1_WRITE0_DONE, 65);
+		}
+		return;
+
+	case T1_WRITE0_DONE:
+		DIRECT_WRITE_HIGH(reg, mask);
+		t1Next(T1_SLOT, 5);
+		return;
+	}
+}
+
+// Runs the state machine from 'state' until it stops itself, with
+// Timer1 powered up only for that long.
+static void t1Run(IO_REG_TYPE mask, volatile IO_REG_TYPE *reg, uint8_t state, uint8_t us)
+{
+	uint8_t prr = PRR;
+
+	t1Mask = mask;
+	t1Reg = reg;
+	PRR = prr & ~_BV(PRTIM1);
+	TCCR1 = ONEWIRE_T1_CLOCK;
+	t1Next(state, us);
+	TIFR = _BV(OCF1A);
+	TIMSK |= _BV(OCIE1A);
+
+	while (TIMSK & _BV(OCIE1A)) ;
+
+	TCCR1 = 0;
+	if (prr & _BV(PRTIM1)) PRR |= _BV(PRTIM1);
+}
+
+uint8_t OneWire::reset(void)
+{
+	noInterrupts();
+	DIRECT_WRITE_LOW(baseReg, bitmask);
+	DIRECT_MODE_OUTPUT(baseReg, bitmask);	// drive output low
+	interrupts();
+
+	t1Run(bitmask, baseReg, T1_RESET_LOW, 240);
+
+	busFailFlag = !t1BusHigh;
+	return t1BusHigh ? t1Presence : 0;
+}
+
+void OneWire::write_bit(uint8_t v)
+{
+	t1Data = v & 1;
+	t1Reading = 0;
+	t1Slots = 1;
+	t1Bytes = 0;
+	t1Run(bitmask, baseReg, T1_SLOT, 2);
+}
+
+uint8_t OneWire::read_bit(void)
+{
+	t1Reading = 1;
+	t1Slots = 1;
+	t1Bytes = 0;
+	t1Run(bitmask, baseReg, T1_SLOT, 2);
+	return t1Data >> 7;
+}
+
+void OneWire::write(uint8_t v, uint8_t power /* = 0 */) {
+	write_bytes(&v, 1, power);
+}
+
+// The whole buffer is one run of the state machine, a slot starts 5us
+// after the last one whatever byte it is in.
+void OneWire::write_bytes(const uint8_t *buf, uint16_t count, bool power /* = 0 */) {
+	if (!count) return;
+
+	t1Data = buf[0];
+	t1Buffer = (uint8_t *)buf + 1;
+	t1Bytes = count - 1;
+	t1Reading = 0;
+	t1Slots = 8;
+	t1Run(bitmask, baseReg, T1_SLOT, 2);
+
+	if ( !power) {
+		noInterrupts();
+		DIRECT_MODE_INPUT(baseReg, bitmask);	// if power not requested, then enable pull-up
+		interrupts();
+	}
+}
+
+uint8_t OneWire::read() {
+	uint8_t r;
+
+	read_bytes(&r, 1);
+	return r;
+}
+
+void OneWire::read_bytes(uint8_t *buf, uint16_t count) {
+	if (!count) return;
+
+	t1Buffer = buf;
+	t1Bytes = count - 1;
+	t1Reading = 1;
+	t1Slots = 8;
+	t1Run(bitmask, baseReg, T1_SLOT, 2);
+	buf[count - 1] = t1Data;
+}
+#endif
 
 //
 // Do a ROM select
 //
 void OneWire::select(const uint8_t rom[8])
 {
-    uint8_t i;
+    uint8_t buf[9];
 
-    write(0x55);           // Choose ROM
-
-    for (i = 0; i < 8; i++) write(rom[i]);
+    buf[0] = 0x55;         // Choose ROM
+    memcpy(buf + 1, rom, 8);
+    write_bytes(buf, 9);
 }
 
 //
@@ -516,7 +739,7 @@ uint8_t OneWire::search(uint8_t *newAddr)
 // "Understanding and Using Cyclic Redundancy Checks with Maxim iButton Products"
 //
 
-#if ONEWIRE_CRC8_TABLE
+#if ONEWIRE_CRC8_TABLE == 1
 // This table comes from Dallas sample code where it is freely reusable,
 // though Copyright (C) 2000 Dallas Semiconductor Corporation
 static const uint8_t PROGMEM dscrc_table[] = {
@@ -544,24 +767,40 @@ static const uint8_t PROGMEM dscrc_table[] = {
 // compared to all those delayMicrosecond() calls.  But I got
 // confused, so I use this table from the examples.)
 //
-uint8_t OneWire::crc8(const uint8_t *addr, uint8_t len)
+uint8_t OneWire::crc8(const uint8_t *addr, uint8_t len, uint8_t crc)
 {
-	uint8_t crc = 0;
-
 	while (len--) {
 		crc = pgm_read_byte(dscrc_table + (crc ^ *addr++));
 	}
 	return crc;
 }
+#elif ONEWIRE_CRC8_TABLE == 2
+// Entry n is what shifting the four bits of n through the CRC leaves,
+// the 256 entry table above is the same thing a byte at a time.
+static const uint8_t PROGMEM dscrc_nibble[] = {
+    0x00, 0x9D, 0x23, 0xBE, 0x46, 0xDB, 0x65, 0xF8,
+    0x8C, 0x11, 0xAF, 0x32, 0xCA, 0x57, 0xE9, 0x74};
+
+//
+// Compute a Dallas Semiconductor 8 bit CRC four bits at a time, about
+// half the speed of the full table for a sixteenth of its flash.
+//
+uint8_t OneWire::crc8(const uint8_t *addr, uint8_t len, uint8_t crc)
+{
+	while (len--) {
+		crc ^= *addr++;
+		crc = (crc >> 4) ^ pgm_read_byte(dscrc_nibble + (crc & 0x0F));
+		crc = (crc >> 4) ^ pgm_read_byte(dscrc_nibble + (crc & 0x0F));
+	}
+	return crc;
+}
 #else
 //
 // Compute a Dallas Semiconductor 8 bit CRC directly.
 // this is much slower, but much smaller, than the lookup table.
 //
-uint8_t OneWire::crc8(const uint8_t *addr, uint8_t len)
+uint8_t OneWire::crc8(const uint8_t *addr, uint8_t len, uint8_t crc)
 {
-	uint8_t crc = 0;
-
 	while (len--) {
 		uint8_t inbyte = *addr++;
 		for (uint8_t i = 8; i; i--) {
@@ -34,11 +34,26 @@
 // by setting this to 1.  The lookup table enlarges code size by
 // about 250 bytes.  It does NOT consume RAM (but did in very
 // old versions of OneWire).  If you disable this, a slower
-// but very compact algorithm is used.
+// but very compact algorithm is used.  Setting it to 2 selects
+// a 16 byte table used a nibble at a time, in between the two.
+//
+// Approximate AVR cost, counted from the instruction sequences:
+//
+//   ONEWIRE_CRC8_TABLE   flash (code + table)   cycles per byte
+//   0, bitwise           ~30 + 0                ~70
+//   1, 256 entries       ~20 + 256              ~13
+//   2, 16 entries        ~34 + 16               ~25
 #ifndef ONEWIRE_CRC8_TABLE
 #define ONEWIRE_CRC8_TABLE 0
 #endif
 
+// Set this to 1 to time the slots from Timer1's compare match A
+// interrupt instead of delay loops with interrupts masked, see
+// OneWire.cpp.  ATtiny85 only, and it takes Timer1 over.
+#ifndef ONEWIRE_TIMER1
+#define ONEWIRE_TIMER1 0
+#endif
+
 // You can allow 16-bit CRC checks by defining this to 1
 // (Note that ONEWIRE_CRC must also be 1.)
 #ifndef ONEWIRE_CRC16
@@ -104,6 +119,17 @@
 #define DIRECT_WRITE_LOW(base, mask)    ((*(base+8+1)) = (mask))          //LATXCLR  + 0x24
 #define DIRECT_WRITE_HIGH(base, mask)   ((*(base+8+2)) = (mask))          //LATXSET + 0x28
 
+#elif defined(ARDUINO_ARCH_NATIVE)
+#define PIN_TO_BASEREG(pin)             (portInputRegister(digitalPinToPort(pin)))
+#define PIN_TO_BITMASK(pin)             (digitalPinToBitMask(pin))
+#define IO_REG_TYPE uint8_t
+#define IO_REG_ASM
+#define DIRECT_READ(base, mask)         (sim_direct_read((base), (mask)))
+#define DIRECT_MODE_INPUT(base, mask)   (sim_direct_mode((base), (mask), 0))
+#define DIRECT_MODE_OUTPUT(base, mask)  (sim_direct_mode((base), (mask), 1))
+#define DIRECT_WRITE_LOW(base, mask)    (sim_direct_write((base), (mask), 0))
+#define DIRECT_WRITE_HIGH(base, mask)   (sim_direct_write((base), (mask), 1))
+
 #else
 #error "Please define I/O register types here"
 #endif
@@ -192,8 +218,9 @@ class OneWire
 
 #if ONEWIRE_CRC
     // Compute a Dallas Semiconductor 8 bit CRC, these are used in the
-    // ROM and scratchpad registers.
-    static uint8_t crc8(const uint8_t *addr, uint8_t len);
+    // ROM and scratchpad registers. Pass a previous result as crc to
+    // continue it over more data.
+    static uint8_t crc8(const uint8_t *addr, uint8_t len, uint8_t crc = 0);
 
 #if ONEWIRE_CRC16
     // Compute the 1-Wire CRC16 and compare it against the received CRC.
@@ -0,0 +1,114 @@
+/*!
+   \file fixed.h
+   \brief Q16.16 arithmetic for the EC_FIXED_POINT conversion path.
+
+   The ATtiny85 has no FPU and avr-libgcc's 64 bit division is slower than
+   its soft-float one, so products widen to 64 bits but quotients are built
+   from a 32 bit division plus a shift-and-subtract loop. Results saturate
+   at +/-32768 instead of wrapping.
+ */
+
+#ifndef fixed_h
+#define fixed_h
+
+#include <stdint.h>
+
+typedef int32_t q16; /*!< 16 integer, 16 fraction bits */
+typedef int32_t q30; /*!< 2 integer, 30 fraction bits, for small coefficients */
+
+#define Q16_ONE 65536L
+#define Q16_MAX INT32_MAX
+
+#define Q16(x) ((q16)((x) * 65536.0 + ((x) < 0 ? -0.5 : 0.5))) /*!< constant to Q16.16 */
+
+static inline q16 q16_saturate(int64_t x)
+{
+  if (x > Q16_MAX) return Q16_MAX;
+  if (x < -Q16_MAX) return -Q16_MAX;
+  return (q16)x;
+}
+
+static inline q16 q16_mul(q16 a, q16 b)
+{
+  return q16_saturate(((int64_t)a * b) >> 16);
+}
+
+static inline q16 q16_div(q16 a, q16 b)
+{
+  bool     negative = (a < 0) != (b < 0);
+  uint32_t n        = (a < 0) ? -(uint32_t)a : a;
+  uint32_t d        = (b < 0) ? -(uint32_t)b : b;
+
+  if (!d) return negative ? -Q16_MAX : Q16_MAX;
+
+  uint32_t q = n / d;
+  uint32_t r = n % d;
+
+  if (q >= 0x8000) return negative ? -Q16_MAX : Q16_MAX;
+
+  for (uint8_t i = 0; i < 16; i++)
+  {
+    q <<= 1;
+    r <<= 1;
+    if (r >= d)
+    {
+      r -= d;
+      q |= 1;
+    }
+  }
+  return negative ? -(q16)q : (q16)q;
+}
+
+// Bit by bit square root. sqrt(x) in Q16.16 is the integer root of x << 16,
+// x below 2 keeps that inside 32 bits.
+static inline q16 q16_sqrt(q16 x)
+{
+  if (x <= 0) return 0;
+  if (x >= 2 * Q16_ONE) return Q16_MAX;
+
+  uint32_t n    = (uint32_t)x << 14; // root comes out in Q.15
+  uint32_t root = 0;
+  uint32_t bit  = 1UL << 30;
+
+  while (bit > n) bit >>= 2;
+
+  while (bit)
+  {
+    if (n >= root + bit)
+    {
+      n   -= root + bit;
+      root = (root >> 1) + bit;
+    }
+    else
+    {
+      root >>= 1;
+    }
+    bit >>= 2;
+  }
+  return root << 1;
+}
+
+// NaN converts to 0, out of range values saturate.
+static inline q16 q16_from_float(float x)
+{
+  if (x != x) return 0;
+  if (x >= 32767.0f) return Q16_MAX;
+  if (x <= -32767.0f) return -Q16_MAX;
+  return (q16)(x * 65536.0f);
+}
+
+// For coefficients below 2 in magnitude, NaN converts to 0.
+static inline q30 q30_from_float(float x)
+{
+  if (x != x) return 0;
+  if (x >= 2.0f) return INT32_MAX;
+  if (x <= -2.0f) return -INT32_MAX;
+  return (q30)(x * 1073741824.0f);
+}
+
+static inline float q16_to_float(q16 x)
+{
+  return x / 65536.0f;
+}
+
+#endif // ifndef fixed_h
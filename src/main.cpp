@@ -24,7 +24,7 @@
 
 /*!
    \file main.cpp
-   \brief EC Salinity firmware ver 1c
+   \brief EC Salinity firmware ver 1d
 
    ufire.co for links to documentation, examples, and libraries
    github.com/u-fire/ec-salinity-probe for feature requests, bug reports, and  questions
@@ -34,23 +34,70 @@
 
 #include <main.h>
 
-double readADC(int channel)
+// Starts the ADC free running on a channel against Vcc. ISR(ADC_vect) sums
+// 2^oversample conversions in the background and sets adcDone.
+//
+// Bipolar sampling swaps POWER_PIN and SINK after each conversion and folds
+// the reversed half-cycles back, so the electrodes see no net charge. The
+// ISR starts every conversion itself there so each one samples after the
+// swap, free running would already be sampling when the ISR runs.
+void startADC(uint8_t channel, uint8_t oversample, bool bipolar)
+{
+  adcTotal      = 0;
+  adcCount      = 0;
+  adcDone       = false;
+  adcOversample = oversample;
+  adcSamples    = 1 << oversample;
+  adcBipolar    = bipolar;
+
+  ADMUX   = channel & 0x0F;
+  ADCSRB  = 0;
+  ADCSRA |= _BV(ADIF) | _BV(ADIE) | _BV(ADSC) | (bipolar ? 0 : _BV(ADATE));
+}
+
+ISR(ADC_vect)
 {
-  uint32_t total       = 0UL;
-  uint16_t sampleCount = 4096;
+  uint16_t sample = ADC;
 
-  for (uint16_t i = 0; i < sampleCount; i++) {
-    total += analogRead(channel);
+  if (adcBipolar)
+  {
+    // reversed, EC_PIN sits at Vcc minus the forward reading
+    if (bit_is_clear(PORTB, POWER_PIN)) sample = 1024 - sample;
+    PORTB ^= _BV(POWER_PIN) | _BV(SINK);
+  }
+
+  adcTotal += sample;
+  if (++adcCount == adcSamples)
+  {
+    // the conversion already under way finishes without an interrupt
+    ADCSRA &= ~(_BV(ADATE) | _BV(ADIE));
+    adcDone = true;
+  }
+  else if (adcBipolar)
+  {
+    ADCSRA |= _BV(ADSC);
   }
+}
 
-  total = total >> 6;
-  double proportional = (total * 1.0) / (0b00000001 << 6);
+// Result of the last startADC() once adcDone is set. Every 4x oversampling
+// buys one bit, the rest of the sum is decimated away.
+double readADC()
+{
+  uint8_t  extraBits = adcOversample / 2;
+  uint32_t total     = adcTotal >> (adcOversample - extraBits);
+
+  double proportional = (total * 1.0) / (0b00000001 << extraBits);
   return proportional;
 }
 
+// Served from the copy receiveEvent() latched, so a float read in one
+// transaction can't pick up half of a reading published while it runs.
+// A read running past the copy gets the live registers.
 void requestEvent()
 {
-  TinyWireS.send(*((uint8_t *)&i2c_register + reg_position));
+  uint8_t offset = (reg_position >= snapshotAt) ? reg_position - snapshotAt : reg_position + reg_size - snapshotAt;
+
+  TinyWireS.send(offset < EC_SNAPSHOT_SIZE ? snapshot[offset] : *((uint8_t *)&i2c_register + reg_position));
 
   reg_position++;
   if (reg_position >= reg_size)
@@ -68,19 +115,27 @@ void receiveEvent(uint8_t howMany)
 
   reg_position = TinyWireS.receive();
   howMany--;
-  if (!howMany)
-  {
-    return;
-  }
 
   while (howMany--)
   {
     *((uint8_t *)&i2c_register + reg_position) = TinyWireS.receive();
 
+    // not persisted, but part of the cached calibration
+    if (reg_position == (EC_TEMPCOEF_REGISTER + 3)) conversionStale = true;
+
+    // a master without a DS18B20 supplies the temperature itself
+    if (reg_position == (EC_TEMP_REGISTER + 3))
+    {
+      tempWritten          = true;
+      i2c_register.tempAge = 0;
+      tempAgeTick          = millis();
+    }
+
     if (reg_position == EC_TASK_REGISTER)
     {
       if (i2c_register.TASK == EC_MEASURE_EC) runEC = true;
       if (i2c_register.TASK == EC_MEASURE_TEMP) runTemp = true;
+      if (i2c_register.TASK == EC_MEASURE_EC_TEMP) runECTemp = true;
       if (i2c_register.TASK == EC_CALIBRATE_PROBE) runCalibrateProbe = true;
       if (i2c_register.TASK == EC_CALIBRATE_LOW) runCalibrateLow = true;
       if (i2c_register.TASK == EC_CALIBRATE_HIGH) runCalibrateHigh = true;
@@ -89,14 +144,7 @@ void receiveEvent(uint8_t howMany)
     }
 
     // save things when all 4 bytes of the float have been received
-    if (reg_position == (EC_K_REGISTER + 3)) EEPROM.put(EC_K_REGISTER, i2c_register.K);
-    if (reg_position == (EC_CALIBRATE_REFHIGH_REGISTER + 3)) EEPROM.put(EC_CALIBRATE_REFHIGH_REGISTER, i2c_register.referenceHigh);
-    if (reg_position == (EC_CALIBRATE_REFLOW_REGISTER + 3)) EEPROM.put(EC_CALIBRATE_REFLOW_REGISTER, i2c_register.referenceLow);
-    if (reg_position == (EC_CALIBRATE_READHIGH_REGISTER + 3)) EEPROM.put(EC_CALIBRATE_READHIGH_REGISTER, i2c_register.readingHigh);
-    if (reg_position == (EC_CALIBRATE_READLOW_REGISTER + 3)) EEPROM.put(EC_CALIBRATE_READLOW_REGISTER, i2c_register.readingLow);
-    if (reg_position == (EC_CALIBRATE_OFFSET_REGISTER + 3)) EEPROM.put(EC_CALIBRATE_OFFSET_REGISTER, i2c_register.calibrationOffset);
-    if (reg_position == (EC_TEMP_COMPENSATION_REGISTER)) EEPROM.put(EC_TEMP_COMPENSATION_REGISTER, i2c_register.tempConstant);
-    if (reg_position == (EC_CONFIG_REGISTER)) EEPROM.put(EC_CONFIG_REGISTER, i2c_register.CONFIG);
+    markDirty(reg_position);
 
     reg_position++;
     if (reg_position >= reg_size)
@@ -104,12 +152,181 @@ void receiveEvent(uint8_t howMany)
       reg_position = 0;
     }
   }
+
+  // a read follows the address write, it sees the registers as of now
+  uint8_t at = reg_position;
+
+  snapshotAt = at;
+  for (uint8_t i = 0; i < EC_SNAPSHOT_SIZE; i++)
+  {
+    snapshot[i] = *((uint8_t *)&i2c_register + at);
+    if (++at >= reg_size) at = 0;
+  }
+}
+
+// Flags a change if 'position' is the last byte of a persisted register.
+// Called from receiveEvent(), which may run inside the USI interrupt.
+void markDirty(uint8_t position)
+{
+  for (uint8_t i = 0; i < EC_PERSISTED; i++)
+  {
+    if (position == pgm_read_byte(&persist[i].reg) + pgm_read_byte(&persist[i].size) - 1)
+    {
+      eepromChanged   = millis();
+      eepromDirty     = true;
+      conversionStale = true;
+    }
+  }
+}
+
+// Byte 'i' of the record saveEEPROM() is writing, read from the live
+// registers so the record never needs a copy in RAM.
+uint8_t recordByte(uint8_t i)
+{
+  if (i == 0) return EC_RECORD_MAGIC;
+  if (i == 1) return EC_PERSISTED;
+  if (i == EC_RECORD_SIZE - 2) return recordSeq + 1;
+  if (i == EC_RECORD_SIZE - 1) return recordCrc;
+
+  i -= 2;
+  for (uint8_t e = 0; e < EC_PERSISTED; e++)
+  {
+    uint8_t size = pgm_read_byte(&persist[e].size);
+
+    if (i < size) return *((uint8_t *)&i2c_register + pgm_read_byte(&persist[e].reg) + i);
+    i -= size;
+  }
+  return 0;
+}
+
+// Reads the first 'entries' persisted registers back from the record at
+// 'address', in persist[] order.
+void unpackRecord(uint16_t address, uint8_t entries)
+{
+  for (uint8_t e = 0; e < entries; e++)
+  {
+    uint8_t *reg  = (uint8_t *)&i2c_register + pgm_read_byte(&persist[e].reg);
+    uint8_t  size = pgm_read_byte(&persist[e].size);
+
+    for (uint8_t i = 0; i < size; i++) reg[i] = EEPROM.read(address++);
+  }
+}
+
+// Saves the persisted registers once they have been left alone for
+// EC_RECORD_SETTLE, so a calibration pushed register by register ends up
+// as one record. It goes to the slot after the newest one, one changed
+// byte per call and only once the EEPROM has finished the previous write,
+// so loop() never waits the ~3.4 ms a write takes. The CRC goes last, a
+// record cut short by a reset never becomes valid. The bytes come from the
+// registers as they are written, a register changed in the meantime would
+// not match the CRC, so the record starts over once they settle again.
+void saveEEPROM()
+{
+  if (recordAt == EC_RECORD_SIZE)
+  {
+    if (!eepromDirty || (millis() - eepromChanged < EC_RECORD_SETTLE)) return;
+
+    noInterrupts();
+    eepromDirty = false;
+    interrupts();
+
+    // rewritten with the values it already had
+    uint16_t newest = EC_RECORD_START + recordSlot * EC_RECORD_SIZE;
+    uint8_t  same   = 0;
+
+    while ((same < EC_RECORD_SIZE - 2) && (EEPROM.read(newest + same) == recordByte(same))) same++;
+    if (same == EC_RECORD_SIZE - 2) return;
+
+    uint8_t crc = 0;
+
+    for (uint8_t i = 0; i < EC_RECORD_SIZE - 1; i++)
+    {
+      uint8_t value = recordByte(i);
+
+      crc = OneWire::crc8(&value, 1, crc);
+    }
+    recordCrc = ~crc;
+    recordAt  = 0;
+  }
+
+  if (!eeprom_is_ready()) return;
+
+  if (eepromDirty)
+  {
+    recordAt = EC_RECORD_SIZE;
+    return;
+  }
+
+  uint8_t  slot = (recordSlot + 1) % EC_RECORD_SLOTS;
+  uint16_t base = EC_RECORD_START + slot * EC_RECORD_SIZE;
+
+  while (recordAt < EC_RECORD_SIZE)
+  {
+    uint8_t value = recordByte(recordAt);
+
+    if (EEPROM.read(base + recordAt) != value)
+    {
+      EEPROM.write(base + recordAt, value);
+      if (++recordAt < EC_RECORD_SIZE) return;
+    }
+    else
+    {
+      recordAt++;
+    }
+  }
+
+  // the CRC is on its way, this is the newest record from here on
+  recordSlot = slot;
+  recordSeq++;
+}
+
+// Unpacks the newest record with a good CRC into the registers. Sequence
+// numbers compare modulo 256, the ring only ever holds a few consecutive
+// ones.
+bool loadRecord()
+{
+  bool found = false;
+
+  for (uint8_t slot = 0; slot < EC_RECORD_SLOTS; slot++)
+  {
+    uint16_t base = EC_RECORD_START + slot * EC_RECORD_SIZE;
+    uint8_t  crc  = 0;
+
+    for (uint8_t i = 0; i < EC_RECORD_SIZE - 1; i++)
+    {
+      uint8_t value = EEPROM.read(base + i);
+
+      crc = OneWire::crc8(&value, 1, crc);
+    }
+
+    uint8_t seq = EEPROM.read(base + EC_RECORD_SIZE - 2);
+
+    if ((EEPROM.read(base) != EC_RECORD_MAGIC) || !EEPROM.read(base + 1)) continue;
+    if (EEPROM.read(base + EC_RECORD_SIZE - 1) != (uint8_t)~crc) continue;
+    if (found && ((int8_t)(seq - recordSeq) <= 0)) continue;
+
+    found      = true;
+    recordSlot = slot;
+    recordSeq  = seq;
+  }
+
+  if (!found) return false;
+
+  uint16_t base    = EC_RECORD_START + recordSlot * EC_RECORD_SIZE;
+  uint8_t  entries = EEPROM.read(base + 1);
+
+  // a record from newer firmware keeps its extra registers to itself
+  unpackRecord(base + 2, min(entries, EC_PERSISTED));
+  if (entries < EC_PERSISTED) eepromDirty = true;
+  return true;
 }
 
 void setup()
 {
   timer1_disable();
-  ds18.setResolution(TEMP_12_BIT);
+  ds18.begin();
+  ds18.setWaitForConversion(false);
+  findTemperatureSensors();
 
   pinMode(EC_PIN,    INPUT);
   pinMode(SINK,      INPUT);
@@ -120,19 +337,44 @@ void setup()
   cbi(ADCSRA, ADPS1);
   cbi(ADCSRA, ADPS0);
 
-  EEPROM.get(EC_I2C_ADDRESS_REGISTER,        EC_SALINITY);
-  EEPROM.get(EC_K_REGISTER,                  i2c_register.K);
-  EEPROM.get(EC_CALIBRATE_REFHIGH_REGISTER,  i2c_register.referenceHigh);
-  EEPROM.get(EC_CALIBRATE_REFLOW_REGISTER,   i2c_register.referenceLow);
-  EEPROM.get(EC_CALIBRATE_READHIGH_REGISTER, i2c_register.readingHigh);
-  EEPROM.get(EC_CALIBRATE_READLOW_REGISTER,  i2c_register.readingLow);
-  EEPROM.get(EC_CALIBRATE_OFFSET_REGISTER,   i2c_register.calibrationOffset);
-  EEPROM.get(EC_DRY_REGISTER,                i2c_register.dry);
-  EEPROM.get(EC_TEMP_COMPENSATION_REGISTER,  i2c_register.tempConstant);
-  EEPROM.get(EC_CONFIG_REGISTER,             i2c_register.CONFIG);
+  EEPROM.get(EC_I2C_ADDRESS_REGISTER, EC_SALINITY);
+
+  // registers a record from older firmware lacks keep these
+  i2c_register.tempBudget   = EC_TEMP_BUDGET_DEFAULT;
+  i2c_register.tempInterval = 0;
+  i2c_register.tempSource   = 0;
+
+  // the first record goes to slot 0
+  recordSlot = EC_RECORD_SLOTS - 1;
+  if (!loadRecord())
+  {
+    // firmware before the record store kept each register at its address
+    EEPROM.get(EC_K_REGISTER,                  i2c_register.K);
+    EEPROM.get(EC_CALIBRATE_REFHIGH_REGISTER,  i2c_register.referenceHigh);
+    EEPROM.get(EC_CALIBRATE_REFLOW_REGISTER,   i2c_register.referenceLow);
+    EEPROM.get(EC_CALIBRATE_READHIGH_REGISTER, i2c_register.readingHigh);
+    EEPROM.get(EC_CALIBRATE_READLOW_REGISTER,  i2c_register.readingLow);
+    EEPROM.get(EC_CALIBRATE_OFFSET_REGISTER,   i2c_register.calibrationOffset);
+    EEPROM.get(EC_DRY_REGISTER,                i2c_register.dry);
+    EEPROM.get(EC_TEMP_COMPENSATION_REGISTER,  i2c_register.tempConstant);
+    EEPROM.get(EC_CONFIG_REGISTER,             i2c_register.CONFIG);
+    EEPROM.get(EC_OVERSAMPLE_REGISTER,         i2c_register.oversample);
+    EEPROM.get(EC_DISCHARGE_REGISTER,          i2c_register.dischargeMax);
+    eepromDirty = true;
+  }
 
   i2c_register.version = VERSION;
   i2c_register.tempC   = -127;
+  i2c_register.tempAge = 0xFFFF;
+  result.tempC         = -127;
+  result.tempRaw       = EC_TEMP_RAW_NONE;
+
+  for (uint8_t i = 0; i < EC_TEMP_SENSORS; i++)
+  {
+    i2c_register.sensorC[i] = -127;
+    result.sensorC[i]       = -127;
+  }
+  i2c_register.tempCount = tempSensorCount;
 
   // if the EEPROM was blank, the i2c address hasn't been changed, make it the default address of 0x3c.
   if (EC_SALINITY == 0xff)
@@ -140,14 +382,27 @@ void setup()
     EC_SALINITY = EC_SALINITY_DEFAULT_ADDRESS;
   }
 
+  // blank or out of range, sample as deep as the accumulator allows
+  if (i2c_register.oversample > ADC_OVERSAMPLE_MAX)
+  {
+    i2c_register.oversample = ADC_OVERSAMPLE_MAX;
+  }
+
+  if (i2c_register.dischargeMax == 0xff)
+  {
+    i2c_register.dischargeMax = EC_DISCHARGE_DEFAULT;
+  }
+
   // check for first time powerup and set default config
-  if (i2c_register.CONFIG.buffer == 0b111111)
+  if (i2c_register.CONFIG.buffer == 0b1111)
   {
     i2c_register.CONFIG.useTempCompensation = 0;
     i2c_register.tempConstant               = 0;
     i2c_register.CONFIG.useDualPoint        = 0;
+    i2c_register.CONFIG.useBipolar          = 0;
+    i2c_register.CONFIG.useContinuous       = 0;
     i2c_register.CONFIG.buffer              = 0;
-    EEPROM.put(EC_CONFIG_REGISTER, i2c_register.CONFIG);
+    eepromDirty                             = true;
   }
 
   TinyWireS.begin(EC_SALINITY);
@@ -159,38 +414,69 @@ void loop()
 {
   low_power();
   TinyWireS_stop_check();
-  if (runTemp)
+  if (runTemp && !tempConverting)
+  {
+    startTemperature();
+    runTemp = false;
+  }
+
+  // the DS18B20 converts while the ADC samples the probe
+  TinyWireS_stop_check();
+  if (runECTemp && !ecTask)
+  {
+    if (!tempConverting) startTemperature();
+    startConductivity(EC_MEASURE_EC_TEMP);
+    runECTemp = false;
+  }
+
+  TinyWireS_stop_check();
+  if (i2c_register.tempInterval && !tempConverting && ((int32_t)(millis() - tempDue) >= 0))
+  {
+    startTemperature();
+  }
+
+  TinyWireS_stop_check();
+  if (tempConverting) readTemperature();
+
+  // tempAge is two bytes, requestEvent() must not see half an update, and
+  // receiveEvent() restarts tempAgeTick, so the test goes with the update
+  TinyWireS_stop_check();
+  noInterrupts();
+  if (millis() - tempAgeTick >= EC_TEMP_AGE_TICK)
   {
-    ds18.requestTemperatures();
-    i2c_register.tempC = ds18.getTempCByIndex(0);
-    runTemp            = false;
+    tempAgeTick += EC_TEMP_AGE_TICK;
+    // a valid age stops one short of 0xFFFF, which means no reading
+    if (i2c_register.tempAge < 0xFFFE) i2c_register.tempAge++;
   }
+  interrupts();
 
   TinyWireS_stop_check();
-  if (runEC)
+  if (runEC && !ecTask)
   {
-    measureConductivity();
+    startConductivity(EC_MEASURE_EC);
     runEC = false;
   }
 
   TinyWireS_stop_check();
-  if (runCalibrateProbe)
+  if (runCalibrateProbe && !ecTask)
   {
-    calibrateProbe();
+    i2c_register.calibrationOffset = NAN;
+    conversionStale                = true;
+    startConductivity(EC_CALIBRATE_PROBE);
     runCalibrateProbe = false;
   }
 
   TinyWireS_stop_check();
-  if (runCalibrateLow)
+  if (runCalibrateLow && !ecTask)
   {
-    calibrateLow();
+    startConductivity(EC_CALIBRATE_LOW);
     runCalibrateLow = false;
   }
 
   TinyWireS_stop_check();
-  if (runCalibrateHigh)
+  if (runCalibrateHigh && !ecTask)
   {
-    calibrateHigh();
+    startConductivity(EC_CALIBRATE_HIGH);
     runCalibrateHigh = false;
   }
 
@@ -202,145 +488,616 @@ void loop()
   }
 
   TinyWireS_stop_check();
-  if (runDry)
+  if (runDry && !ecTask)
   {
-    calibrateDry();
+    startConductivity(EC_DRY);
     runDry = false;
   }
+
+  // continuous mode takes the probe whenever no task wants it
+  TinyWireS_stop_check();
+  if (i2c_register.CONFIG.useContinuous && !ecTask &&
+      !(runEC || runECTemp || runCalibrateProbe || runCalibrateLow || runCalibrateHigh || runDry))
+  {
+    startConductivity(EC_MEASURE_EC);
+  }
+
+  TinyWireS_stop_check();
+  if (ecTask && adcDone && !discharging && !ecPending)
+  {
+    if (ecTask == EC_MEASURE_EC_TEMP)
+    {
+      sampleConductivity();
+      ecPending = true;
+    }
+    else
+    {
+      measureConductivity();
+    }
+    if (ecTask == EC_CALIBRATE_PROBE) calibrateProbe();
+    if (ecTask == EC_CALIBRATE_LOW) calibrateLow();
+    if (ecTask == EC_CALIBRATE_HIGH) calibrateHigh();
+    if (ecTask == EC_DRY) calibrateDry();
+  }
+
+  TinyWireS_stop_check();
+  if (ecPending && !tempConverting)
+  {
+    ecPending = false;
+    convertConductivity();
+    if (!discharging) ecTask = 0;
+  }
+
+  TinyWireS_stop_check();
+  if (discharging)
+  {
+    discharge();
+  }
+
+  TinyWireS_stop_check();
+  if (!TinyWireS.available())
+  {
+    saveEEPROM();
+  }
 }
 
-float measureConductivity()
+// Powers the probe and starts sampling it, loop() calls measureConductivity()
+// and then finishes 'task' once the ADC is done.
+void startConductivity(uint8_t task)
 {
-  float inputV, outputV, mS, resistance;
-  uint32_t analogRaw;
-
   pinMode(POWER_PIN, OUTPUT);
   pinMode(SINK,      OUTPUT);
   digitalWrite(POWER_PIN, HIGH);
   digitalWrite(SINK,      LOW);
 
-  analogRaw = readADC(EC_PIN);
+  ecTask = task;
+  startADC(EC_PIN, min(i2c_register.oversample, ADC_OVERSAMPLE_MAX), i2c_register.CONFIG.useBipolar);
+}
 
-  digitalWrite(POWER_PIN, LOW);
-  digitalWrite(SINK,      LOW);
-  digitalWrite(EC_PIN,    LOW);
-  tws_delay(1000);
+static inline ecvalue ec(float x)
+{
+#ifdef EC_FIXED_POINT
+  return q16_from_float(x);
+#else // ifdef EC_FIXED_POINT
+  return x;
+#endif // ifdef EC_FIXED_POINT
+}
 
-  pinMode(POWER_PIN, INPUT);
-  pinMode(SINK,      INPUT);
+// Folds the cell constant and single and dual point calibration into
+// mS = ratio * slope + intercept, with the stages that are off compiled
+// out. Ratio is the divider's (Vin / Vout - 1), 1 / R in units of
+// Resistor. Only runs when an input changed, compensate() then scales the
+// slope for the temperature.
+template<bool offset, bool dualPoint>
+void conversion()
+{
+  float slope     = (100000 / Resistor) * i2c_register.K;
+  float intercept = 0;
 
-  inputV  = getVin();
-  outputV = (inputV * analogRaw) / 1024.0;
+  if (offset)
+  {
+    slope = slope - (slope * i2c_register.calibrationOffset);
+  }
+
+  if (dualPoint)
+  {
+    float scale = (i2c_register.referenceHigh - i2c_register.referenceLow) /
+                  (i2c_register.readingHigh - i2c_register.readingLow);
+
+    slope    *= scale;
+    intercept = i2c_register.referenceLow - i2c_register.readingLow * scale;
+  }
 
-  resistance = Resistor * (1 / ((inputV / outputV) - 1));
-  mS         = ((100000 * i2c_register.K) / resistance);
+  coefficients.base      = ec(slope);
+  coefficients.intercept = ec(intercept);
+}
+
+// Indexed by a usable single point offset and useDualPoint, in that bit
+// order.
+static const converter conversions[] PROGMEM = {
+  conversion<false, false>, conversion<true, false>,
+  conversion<false, true>,  conversion<true, true>
+};
 
-  // Compensate for temperature if configured.
-  if (i2c_register.CONFIG.useTempCompensation)
+// slope = base / (1 + tempCoef * (T - tempConstant)), redone whenever the
+// temperature changes. T stays in the DS18B20's 1/128 C, so the fixed
+// point build does it without any float.
+void compensate(int16_t tempRaw)
+{
+  coefficients.tempRaw = tempRaw;
+  if (!coefficients.compensate)
   {
-    mS =  mS / (1.0 + i2c_register.tempCoef * (i2c_register.tempC - i2c_register.tempConstant));
+    coefficients.slope = coefficients.base;
+    return;
   }
 
-  // Use single point adjustment, ignoring if NaN
-  if (i2c_register.calibrationOffset == i2c_register.calibrationOffset)
+  int32_t dt = tempRaw - ((int16_t)i2c_register.tempConstant << 7);
+
+#ifdef EC_FIXED_POINT
+  // Q2.30 per C times 1/128 C is 37 fraction bits
+  coefficients.slope = q16_div(coefficients.base, Q16_ONE + (q16)(((int64_t)coefficients.tempCoef * dt) >> 21));
+#else // ifdef EC_FIXED_POINT
+  coefficients.slope = coefficients.base / (1.0f + coefficients.tempCoef * dt);
+#endif // ifdef EC_FIXED_POINT
+}
+
+// The DS18B20's unit for a temperature the master wrote. Anything an
+// int16_t can't hold reads as no temperature.
+int16_t celsiusToRaw(float tempC)
+{
+  if (!((tempC > -255) && (tempC < 255))) return EC_TEMP_RAW_NONE;
+  return (int16_t)(tempC * 128 + (tempC < 0 ? -0.5f : 0.5f));
+}
+
+// Runs once the CONFIG bits or the single point offset may have changed
+// instead of testing them, and the offset for NaN, on every reading.
+void selectConversion()
+{
+  conversionStale = false;
+
+  uint8_t variant = 0;
+
+  // a NaN offset means single point calibration is not in use
+  if (i2c_register.calibrationOffset == i2c_register.calibrationOffset) variant |= 1;
+  if (i2c_register.CONFIG.useDualPoint) variant |= 2;
+
+  convert = (converter)pgm_read_ptr(&conversions[variant]);
+
+  coefficients.compensate = i2c_register.CONFIG.useTempCompensation;
+#ifdef EC_FIXED_POINT
+  coefficients.tempCoef = q30_from_float(i2c_register.tempCoef);
+#else // ifdef EC_FIXED_POINT
+  coefficients.tempCoef = i2c_register.tempCoef / 128;
+#endif // ifdef EC_FIXED_POINT
+}
+
+float measureConductivity()
+{
+  sampleConductivity();
+  return convertConductivity();
+}
+
+// Takes the finished ADC pass and releases the probe to discharge.
+void sampleConductivity()
+{
+#ifdef EC_FIXED_POINT
+  // Keeps the extra bits readADC() does. Vcc cancels out of the divider, so
+  // there is no getVin() here: the ratio is (full - raw) / raw.
+  uint8_t  extraBits = adcOversample / 2;
+  uint32_t analogRaw = adcTotal >> (adcOversample - extraBits);
+  uint32_t full      = 1024UL << extraBits;
+
+  startDischarge();
+
+  // the ratio with 22 fraction bits, it is small in salt water; the
+  // remainder is divided out bit by bit as in q16_div()
+  ecRatio = UINT32_MAX;
+  if (analogRaw)
   {
-    mS = mS - (mS * i2c_register.calibrationOffset);
+    uint32_t q = (full - analogRaw) / analogRaw;
+    uint32_t r = (full - analogRaw) % analogRaw;
+
+    if (q < 1024)
+    {
+      for (uint8_t i = 0; i < 22; i++)
+      {
+        q <<= 1;
+        r <<= 1;
+        if (r >= analogRaw)
+        {
+          r -= analogRaw;
+          q |= 1;
+        }
+      }
+      ecRatio = q;
+    }
   }
+#else // ifdef EC_FIXED_POINT
+  float inputV, outputV;
+  float analogRaw;
+
+  analogRaw = readADC();
+  startDischarge();
+
+  inputV  = getVin();
+  outputV = (inputV * analogRaw) / 1024.0;
+  ecRatio = (inputV / outputV) - 1;
+#endif // ifdef EC_FIXED_POINT
+}
+
+float convertConductivity()
+{
+  float   mS;
+  ecvalue siemens;
 
-  if (i2c_register.CONFIG.useDualPoint)
+  // the master may have written a temperature since the last publish()
+  if (tempWritten)
   {
-    // Use dual point calibration.
-    float referenceRange = i2c_register.referenceHigh - i2c_register.referenceLow;
-    float readingRange   = i2c_register.readingHigh - i2c_register.readingLow;
+    noInterrupts();
+    tempWritten  = false;
+    result.tempC = i2c_register.tempC;
+    interrupts();
+    result.tempRaw = celsiusToRaw(result.tempC);
+  }
 
-    mS = (((mS - i2c_register.readingLow) * referenceRange) / readingRange) + i2c_register.referenceLow;
+  if (conversionStale)
+  {
+    selectConversion();
+    convert();
+    compensate(result.tempRaw);
   }
+  else if (result.tempRaw != coefficients.tempRaw)
+  {
+    compensate(result.tempRaw);
+  }
+
+#ifdef EC_FIXED_POINT
+  siemens = q16_saturate(((int64_t)ecRatio * coefficients.slope) >> 22) + coefficients.intercept;
+  mS      = q16_to_float(siemens);
+#else // ifdef EC_FIXED_POINT
+  siemens = ecRatio * coefficients.slope + coefficients.intercept;
+  mS      = siemens;
+#endif // ifdef EC_FIXED_POINT
 
   // Check if the probe is dry/disconnected
   if (mS <= i2c_register.dry) mS = -1;
 
-  i2c_register.mS = mS;
-  _salinity(i2c_register.tempC);
+  result.mS = mS;
+  result.salinityValid = _salinity(result.tempRaw);
+  publish();
   return mS;
 }
 
+// Hands a complete reading to the I2C side. requestEvent() runs from the
+// USI interrupt, masking it means no byte is served from a half-copied set.
+//
+// The reading is also copied into the results block, where a master gets
+// it in one read of EC_RESULTS_SIZE bytes and can tell a fresh one by the
+// sequence number.
+void publish()
+{
+  results block;
+
+  block.status = 0;
+  if (result.mS == -1) block.status |= EC_STATUS_DRY;
+  if (result.tempC == -127) block.status |= EC_STATUS_NO_TEMP;
+  if (!result.salinityValid) block.status |= EC_STATUS_NO_SALINITY;
+
+  block.sequence    = i2c_register.block.sequence + 1;
+  block.mS          = result.mS;
+  block.tempC       = result.tempC;
+  block.salinityPSU = result.salinityPSU;
+  block.crc         = OneWire::crc8((uint8_t *)&block, EC_RESULTS_SIZE - 1);
+
+  noInterrupts();
+  i2c_register.mS          = result.mS;
+  i2c_register.tempC       = result.tempC;
+  i2c_register.salinityPSU = result.salinityPSU;
+  i2c_register.block       = block;
+  i2c_register.tempCount   = tempSensorCount;
+  for (uint8_t i = 0; i < EC_TEMP_SENSORS; i++) i2c_register.sensorC[i] = result.sensorC[i];
+  interrupts();
+}
+
+// Shorts the cell through the series resistor once it has been read.
+// discharge() then frees the probe for the next task as soon as the
+// electrodes have depolarised, or after dischargeMax at the latest.
+void startDischarge()
+{
+  digitalWrite(POWER_PIN, LOW);
+  digitalWrite(SINK,      LOW);
+  digitalWrite(EC_PIN,    LOW);
+
+  discharging    = true;
+  dischargeProbe = false;
+  dischargeStart = millis();
+  dischargeCheck = dischargeStart;
+}
+
+void discharge()
+{
+  uint32_t now     = millis();
+  bool     settled = false;
+
+  if (dischargeProbe)
+  {
+    if (!adcDone) return;
+
+    // with POWER_PIN open EC_PIN sat at SINK plus the residual polarisation
+    pinMode(POWER_PIN, OUTPUT);
+    dischargeProbe = false;
+    dischargeCheck = now + EC_DISCHARGE_POLL;
+    settled        = readADC() <= EC_DISCHARGE_THRESHOLD;
+  }
+
+  if (settled || (now - dischargeStart >= i2c_register.dischargeMax * 10UL))
+  {
+    pinMode(POWER_PIN, INPUT);
+    pinMode(SINK,      INPUT);
+    discharging = false;
+    if (!ecPending) ecTask = 0;
+    return;
+  }
+
+  if ((int32_t)(now - dischargeCheck) >= 0)
+  {
+    pinMode(POWER_PIN, INPUT);
+    dischargeProbe = true;
+    startADC(EC_PIN, 2, false);
+  }
+}
+
+// The finest resolution whose datasheet conversion time fits tempBudget,
+// 9 bit when none does.
+uint8_t temperatureResolution()
+{
+  uint8_t bits = 12;
+
+  while (bits > 9 && ds18.millisToWaitForConversion(bits) > i2c_register.tempBudget * 10) bits--;
+  return bits;
+}
+
+// Up to EC_TEMP_SENSORS in search order, which is by ROM code, so a
+// sensor keeps its index while the same ones are on the bus.
+void findTemperatureSensors()
+{
+  DeviceAddress rom;
+
+  tempSensorCount = 0;
+  oneWire.reset_search();
+  while (tempSensorCount < EC_TEMP_SENSORS && oneWire.search(rom))
+  {
+    if (!ds18.validAddress(rom) || !ds18.validFamily(rom)) continue;
+
+    memcpy(tempSensors[tempSensorCount++], rom, sizeof(rom));
+  }
+}
+
+void startTemperature()
+{
+  uint8_t bits = temperatureResolution();
+
+  // Only the scratchpad, copying it to the sensor's EEPROM would wear it
+  // and block for 20 ms. tempBits starts at 0, so the first conversion
+  // after power up always sets it.
+  if (bits != tempBits)
+  {
+    oneWire.reset();
+    oneWire.skip();
+    oneWire.write(WRITESCRATCH);
+    oneWire.write(0x7F); // alarm limits, unused
+    oneWire.write(0x80);
+    oneWire.write(((bits - 9) << 5) | TEMP_9_BIT);
+    tempBits = bits;
+  }
+
+  ds18.requestTemperatures();
+  tempConverting = true;
+  tempStart      = millis();
+  tempCheck      = tempStart;
+  tempDue        = tempStart + i2c_register.tempInterval * 1000UL;
+}
+
+// Finishes a conversion started by startTemperature(). A parasite powered sensor can't
+// signal completion, so it only gets the datasheet deadline.
+void readTemperature()
+{
+  uint32_t now  = millis();
+  bool     done = now - tempStart >= (uint16_t)ds18.millisToWaitForConversion(tempBits);
+
+  if (!done && !ds18.isParasitePowerMode() && (int32_t)(now - tempCheck) >= 0)
+  {
+    tempCheck = now + EC_TEMP_POLL;
+    done      = ds18.isConversionComplete();
+  }
+  if (!done) return;
+
+  int16_t sensorRaw[EC_TEMP_SENSORS];
+  bool    failed = !tempSensorCount;
+
+  for (uint8_t i = 0; i < tempSensorCount; i++)
+  {
+    sensorRaw[i] = ds18.getTemp(tempSensors[i]);
+    if (sensorRaw[i] == DEVICE_DISCONNECTED_RAW) failed = true;
+  }
+
+  // A failed CRC may be a sensor added, removed or replaced, search the bus
+  // again. requestTemperatures() is a broadcast, so new ones converted too,
+  // at their own resolution until the next conversion resets it.
+  if (failed)
+  {
+    tempBits = 0;
+    findTemperatureSensors();
+    for (uint8_t i = 0; i < tempSensorCount; i++) sensorRaw[i] = ds18.getTemp(tempSensors[i]);
+  }
+
+  // raw from here on, a float only for the registers
+  for (uint8_t i = 0; i < EC_TEMP_SENSORS; i++)
+  {
+    if ((i >= tempSensorCount) || (sensorRaw[i] == DEVICE_DISCONNECTED_RAW)) sensorRaw[i] = EC_TEMP_RAW_NONE;
+    result.sensorC[i] = DallasTemperature::rawToCelsius(sensorRaw[i]);
+  }
+
+  int16_t tempRaw = EC_TEMP_RAW_NONE;
+
+  if (i2c_register.tempSource < EC_TEMP_AVERAGE)
+  {
+    tempRaw = sensorRaw[i2c_register.tempSource];
+  }
+  else
+  {
+    int32_t sum   = 0;
+    uint8_t valid = 0;
+
+    for (uint8_t i = 0; i < tempSensorCount; i++)
+    {
+      if (sensorRaw[i] == EC_TEMP_RAW_NONE) continue;
+
+      sum += sensorRaw[i];
+      valid++;
+    }
+    if (valid) tempRaw = sum / valid;
+  }
+
+  result.tempRaw = tempRaw;
+  result.tempC   = DallasTemperature::rawToCelsius(tempRaw);
+  tempConverting = false;
+  // a failed read publishes -127, the age can't go on counting from the
+  // last good one
+  noInterrupts();
+  if (tempRaw == EC_TEMP_RAW_NONE)
+  {
+    i2c_register.tempAge = 0xFFFF;
+  }
+  else
+  {
+    i2c_register.tempAge = 0;
+    tempAgeTick          = now;
+  }
+  interrupts();
+  publish();
+}
+
 void calibrateProbe()
 {
-  i2c_register.calibrationOffset = NAN;
-  float mS = measureConductivity();
+  float mS = i2c_register.mS;
 
   i2c_register.calibrationOffset = (mS - i2c_register.solutionEC) / mS;
-  EEPROM.put(EC_CALIBRATE_OFFSET_REGISTER, i2c_register.calibrationOffset);
+  markDirty(EC_CALIBRATE_OFFSET_REGISTER + 3);
 }
 
 void calibrateLow()
 {
   i2c_register.referenceLow = i2c_register.solutionEC;
-  measureConductivity();
   i2c_register.readingLow = i2c_register.mS;
-  EEPROM.put(EC_CALIBRATE_REFLOW_REGISTER,  i2c_register.referenceLow);
-  EEPROM.put(EC_CALIBRATE_READLOW_REGISTER, i2c_register.readingLow);
+  markDirty(EC_CALIBRATE_REFLOW_REGISTER + 3);
+  markDirty(EC_CALIBRATE_READLOW_REGISTER + 3);
 }
 
 void calibrateHigh()
 {
   i2c_register.referenceHigh = i2c_register.solutionEC;
-  measureConductivity();
   i2c_register.readingHigh = i2c_register.mS;
-  EEPROM.put(EC_CALIBRATE_REFHIGH_REGISTER,  i2c_register.referenceHigh);
-  EEPROM.put(EC_CALIBRATE_READHIGH_REGISTER, i2c_register.readingHigh);
+  markDirty(EC_CALIBRATE_REFHIGH_REGISTER + 3);
+  markDirty(EC_CALIBRATE_READHIGH_REGISTER + 3);
 }
 
-void _salinity(float temp)
+// Temperature terms of PSS-78, only redone when the temperature changes:
+// 42.9 mS/cm times rt(T), the standard seawater conductivity ratio, and
+// the a and b series merged into one polynomial in sqrt(r) by scaling b
+// with (T - 15) / (1 + 0.0162 (T - 15)). rt(T) is interpolated from
+// rtTable, within 5e-5 of the polynomial. tempRaw is in 1/128 C and has
+// to be within -2..35 C.
+void salinityLookup(int16_t tempRaw)
 {
-  float r, ds, r2;
+  q16      t = (int32_t)(tempRaw + 2 * 128) << 9;
+  uint8_t  i = t >> 16;
+  uint16_t f = t & 0xFFFF;
+  q30      rt = (q30)pgm_read_word(&rtTable[i]) << 15;
 
-  float a0 = 0.008;
-  float a1 = -0.1692;
-  float a2 = 25.3851;
-  float a3 = 14.0941;
-  float a4 = -7.0261;
-  float a5 = 2.7081;
+  if (i < EC_RT_ENTRIES - 1)
+  {
+    rt += (((int32_t)pgm_read_word(&rtTable[i + 1]) - (int32_t)pgm_read_word(&rtTable[i])) * f) >> 1;
+  }
 
-  float b0 = 0.0005;
-  float b1 = -0.0056;
-  float b2 = -0.0066;
-  float b3 = -0.0375;
-  float b4 = 0.0636;
-  float b5 = -0.0144;
+#ifdef EC_FIXED_POINT
+  q16 dt = ((int32_t)tempRaw << 9) - Q16(15);
+  q16 ds = q16_div(dt, Q16_ONE + q16_mul(Q16(0.0162), dt));
 
-  float c0 = 0.6766097;
-  float c1 = 0.0200564;
-  float c2 = 0.0001104259;
-  float c3 = -0.00000069698;
-  float c4 = 0.0000000010031;
+  salinityTerms.rt = ((int64_t)rt * Q16(42.9)) >> 30;
+  for (uint8_t k = 0; k < 6; k++)
+  {
+    salinityTerms.c[k] = (q16)pgm_read_dword(&pss78a[k]) + q16_mul((q16)pgm_read_dword(&pss78b[k]), ds);
+  }
+#else // ifdef EC_FIXED_POINT
+  float temp = tempRaw / 128.0f;
+  float ds   = (temp - 15.0) / (1.0 + 0.0162 * (temp - 15.0));
 
-  if ((temp == -127) || (temp = 0.0))
+  salinityTerms.rt = rt * (42.9f / 1073741824.0f);
+  for (uint8_t k = 0; k < 6; k++)
   {
-    temp = 25;
+    salinityTerms.c[k] = pgm_read_float(&pss78a[k]) + pgm_read_float(&pss78b[k]) * ds;
   }
-  r  = (i2c_register.mS * 1000) / 42900;
-  r /= (c0 + temp * (c1 + temp * (c2 + temp * (c3 + temp * c4))));
+#endif // ifdef EC_FIXED_POINT
+  salinityTerms.tempRaw = tempRaw;
+}
 
-  r2 = sqrtf(r);
-  ds = b0 + r2 * (b1 + r2 * (b2 + r2 * (b3 + r2 * (b4 + r2 * b5))));
-  ds = ds * ((temp - 15.0) / (1.0 + 0.0162 * (temp - 15.0)));
+#ifdef EC_FIXED_POINT
+// PSS-78 in fixed point. r >= 2 is above 42 PSU anyway, which keeps the
+// square root inside 32 bits.
+bool _salinity(int16_t tempRaw)
+{
+  q16 r, r2, psu;
 
-  i2c_register.salinityPSU = a0 + r2 * (a1 + r2 * (a2 + r2 * (a3 + r2 * (a4 + r2 * a5)))) + ds;
+  if (tempRaw == EC_TEMP_RAW_NONE)
+  {
+    tempRaw = 25 * 128;
+  }
 
-  if ((i2c_register.salinityPSU < 2) || (i2c_register.salinityPSU > 42))
+  if ((tempRaw < -2 * 128) || (tempRaw > 35 * 128) || !(result.mS > 0))
   {
-    i2c_register.salinityPSU = -1;
-    return;
+    result.salinityPSU = -1;
+    return false;
   }
 
-  if ((temp < -2) || (temp > 35))
+  if (tempRaw != salinityTerms.tempRaw) salinityLookup(tempRaw);
+
+  r = q16_div(q16_from_float(result.mS), salinityTerms.rt);
+  if (r >= 2 * Q16_ONE)
   {
-    i2c_register.salinityPSU = -1;
-    return;
+    result.salinityPSU = -1;
+    return false;
+  }
+
+  r2  = q16_sqrt(r);
+  psu = salinityTerms.c[5];
+  for (int8_t k = 4; k >= 0; k--) psu = salinityTerms.c[k] + q16_mul(psu, r2);
+
+  if ((psu < Q16(2)) || (psu > Q16(42)))
+  {
+    result.salinityPSU = -1;
+    return false;
   }
+  result.salinityPSU = q16_to_float(psu);
+  return true;
 }
 
+#else // ifdef EC_FIXED_POINT
+// avr-libc's sqrt() is shift-and-subtract assembly, without a hardware
+// multiplier any Newton step on a reciprocal root guess costs more.
+bool _salinity(int16_t tempRaw)
+{
+  float r, r2;
+
+  if (tempRaw == EC_TEMP_RAW_NONE)
+  {
+    tempRaw = 25 * 128;
+  }
+
+  if ((tempRaw < -2 * 128) || (tempRaw > 35 * 128) || !(result.mS > 0))
+  {
+    result.salinityPSU = -1;
+    return false;
+  }
+
+  if (tempRaw != salinityTerms.tempRaw) salinityLookup(tempRaw);
+
+  r  = result.mS / salinityTerms.rt;
+  r2 = sqrtf(r);
+
+  result.salinityPSU = salinityTerms.c[5];
+  for (int8_t k = 4; k >= 0; k--) result.salinityPSU = salinityTerms.c[k] + result.salinityPSU * r2;
+
+  if (!((result.salinityPSU >= 2) && (result.salinityPSU <= 42)))
+  {
+    result.salinityPSU = -1;
+    return false;
+  }
+  return true;
+}
+
+#endif // ifdef EC_FIXED_POINT
+
 void setI2CAddress()
 {
   // for convenience, the solution register is used to send the address
@@ -350,7 +1107,6 @@ void setI2CAddress()
 
 void calibrateDry()
 {
-  measureConductivity();
   i2c_register.dry = i2c_register.mS;
-  EEPROM.put(EC_DRY_REGISTER, i2c_register.dry);
+  markDirty(EC_DRY_REGISTER + 3);
 }
@@ -4,8 +4,9 @@
 #include <DallasTemperature.h>
 #include <avr/sleep.h>
 #include <EEPROM.h>
+#include <fixed.h>
 
-#define VERSION 0x1c
+#define VERSION 0x1d
 #define EC_SALINITY_DEFAULT_ADDRESS 0x3C
 
 #define ACCURACY 6
@@ -13,6 +14,7 @@
 uint8_t EC_SALINITY = 0x3C; /*!< EC Salinity probe I2C address */
 #define EC_MEASURE_EC 80
 #define EC_MEASURE_TEMP 40
+#define EC_MEASURE_EC_TEMP 120 /*!< temperature and EC together, compensated with the new temperature */
 #define EC_CALIBRATE_PROBE 20
 #define EC_CALIBRATE_LOW 10
 #define EC_CALIBRATE_HIGH 8
@@ -35,43 +37,227 @@ uint8_t EC_SALINITY = 0x3C; /*!< EC Salinity probe I2C address */
 #define EC_TEMP_COMPENSATION_REGISTER 49  /*!< temperature compensation register */
 #define EC_CONFIG_REGISTER 50             /*!< config register */
 #define EC_TASK_REGISTER 51               /*!< task register */
+#define EC_OVERSAMPLE_REGISTER 52         /*!< log2 of ADC samples per reading */
+#define EC_DISCHARGE_REGISTER 53          /*!< discharge time limit in 10 ms steps */
+#define EC_RESULTS_REGISTER 54            /*!< status, sequence, mS, temp, PSU and CRC in one read */
+#define EC_RESULTS_SIZE 15                /*!< bytes in the results block */
+#define EC_TEMP_BUDGET_REGISTER 69        /*!< DS18B20 conversion time limit in 10 ms steps */
+#define EC_TEMP_INTERVAL_REGISTER 70      /*!< s between background temperature readings, 0 for none */
+#define EC_TEMP_AGE_REGISTER 71           /*!< 0.1 s since tempC was updated, 0xFFFF while it is -127 */
+#define EC_TEMP_SOURCE_REGISTER 73        /*!< DS18B20 used as tempC, EC_TEMP_AVERAGE for their mean */
+#define EC_TEMP_COUNT_REGISTER 74         /*!< DS18B20 sensors found on the bus */
+#define EC_TEMP_SENSOR_REGISTER 75        /*!< each sensor's temperature in C, EC_TEMP_SENSORS floats */
 
 #define EC_I2C_ADDRESS_REGISTER 200
 
+#define EC_TEMP_SENSORS 4 /*!< DS18B20 sensors read on DS18_PIN */
+#define EC_TEMP_AVERAGE 4 /*!< tempSource from here up: mean of the sensors that answered */
+#define EC_TEMP_RAW_NONE (-127 * 128) /*!< no temperature in 1/128 C, -127 like tempC */
+
+#define EC_STATUS_DRY 0x01         /*!< mS is -1, probe dry or disconnected */
+#define EC_STATUS_NO_TEMP 0x02     /*!< no temperature reading, tempC is -127 */
+#define EC_STATUS_NO_SALINITY 0x04 /*!< salinity out of range, PSU is -1 */
+
 struct config
 {
   uint8_t useDualPoint        : 1; // 0
   uint8_t useTempCompensation : 1; // 1
-  uint8_t buffer              : 6; // 2-7
+  uint8_t useBipolar          : 1; // 2
+  uint8_t useContinuous       : 1; // 3
+  uint8_t buffer              : 4; // 4-7
+};
+
+// The register map is also the I2C wire format. AVR has no alignment, the
+// native build has to be told so the offsets below hold there too.
+#ifdef ARDUINO_ARCH_NATIVE
+typedef float    regfloat __attribute__((aligned(1)));
+typedef uint16_t reguint16 __attribute__((aligned(1)));
+#else // ifdef ARDUINO_ARCH_NATIVE
+typedef float    regfloat;
+typedef uint16_t reguint16;
+#endif // ifdef ARDUINO_ARCH_NATIVE
+
+// The last reading in one contiguous block, EC_RESULTS_REGISTER onwards.
+struct results {
+  uint8_t  status;      // EC_STATUS_ bits
+  uint8_t  sequence;    // counts publish() calls
+  regfloat mS;
+  regfloat tempC;
+  regfloat salinityPSU;
+  uint8_t  crc;         // OneWire CRC-8 of the bytes above
 };
 
 struct rev1_register {
-  uint8_t version;           // 0
-  float   mS;                // 1-4
-  float   tempC;             // 5-8
-  float   K;                 // 9-12
-  float   solutionEC;        // 13-16
-  float   tempCoef;          // 17-20
-  float   referenceHigh;     // 21-24
-  float   referenceLow;      // 25-28
-  float   readingHigh;       // 29-32
-  float   readingLow;        // 33-36
-  float   calibrationOffset; // 37-40
-  float   salinityPSU;       // 41-44
-  float   dry;               // 45-48
-  uint8_t tempConstant;      // 49
-  config  CONFIG;            // 50
-  uint8_t TASK;              // 51
+  uint8_t  version;           // 0
+  regfloat mS;                // 1-4
+  regfloat tempC;             // 5-8
+  regfloat K;                 // 9-12
+  regfloat solutionEC;        // 13-16
+  regfloat tempCoef;          // 17-20
+  regfloat referenceHigh;     // 21-24
+  regfloat referenceLow;      // 25-28
+  regfloat readingHigh;       // 29-32
+  regfloat readingLow;        // 33-36
+  regfloat calibrationOffset; // 37-40
+  regfloat salinityPSU;       // 41-44
+  regfloat dry;               // 45-48
+  uint8_t  tempConstant;      // 49
+  config   CONFIG;            // 50
+  uint8_t  TASK;              // 51
+  uint8_t  oversample;        // 52
+  uint8_t  dischargeMax;      // 53
+  results  block;             // 54-68
+  uint8_t  tempBudget;        // 69
+  uint8_t  tempInterval;      // 70
+  reguint16 tempAge;          // 71-72
+  uint8_t  tempSource;        // 73
+  uint8_t  tempCount;         // 74
+  regfloat sensorC[EC_TEMP_SENSORS]; // 75-90
 } i2c_register;
 
+// What requestEvent() serves, see receiveEvent(): the EC_SNAPSHOT_SIZE
+// bytes from snapshotAt on, wrapping at the end of the registers.
+#define EC_SNAPSHOT_SIZE 16 /*!< longest transaction, TinyWireS' buffer */
+
+uint8_t          snapshot[EC_SNAPSHOT_SIZE];
+volatile uint8_t snapshotAt;
+
+// The outputs of one reading. loop() fills 'result' while i2c_register keeps
+// serving the previous one, publish() then swaps it in as a whole.
+struct measurement
+{
+  float   mS;
+  float   tempC;
+  float   salinityPSU;
+  float   sensorC[EC_TEMP_SENSORS]; // each DS18B20, converted once per read
+  int16_t tempRaw;                  // tempC in the DS18B20's 1/128 C, see compensate()
+  bool    salinityValid;            // what _salinity() returned, see publish()
+} result;
+
+// The calibration coefficients are in the build's number format.
+#ifdef EC_FIXED_POINT
+typedef q16 ecvalue;
+typedef q30 eccoef;   // tempCoef per C
+#else // ifdef EC_FIXED_POINT
+typedef float ecvalue;
+typedef float eccoef; // tempCoef per 1/128 C
+#endif // ifdef EC_FIXED_POINT
+
+// The divider's (Vin / Vout - 1) from sampleConductivity(), held until
+// convertConductivity() has the temperature it needs.
+#ifdef EC_FIXED_POINT
+uint32_t ecRatio; // 22 fraction bits
+#else // ifdef EC_FIXED_POINT
+float ecRatio;
+#endif // ifdef EC_FIXED_POINT
+
+typedef void (*converter)();
+
+// mS = ratio * slope + intercept, see conversion() and compensate()
+struct calibration
+{
+  ecvalue base;       // slope before temperature compensation
+  ecvalue slope;
+  ecvalue intercept;
+  eccoef  tempCoef;
+  bool    compensate; // CONFIG.useTempCompensation
+  int16_t tempRaw;    // compensated for
+} coefficients;
+
+converter     convert;                 // refreshes coefficients for the current CONFIG
+volatile bool conversionStale = true;  // a calibration input changed, see selectConversion()
+volatile bool tempWritten     = false; // the master wrote tempC, see convertConductivity()
+
+// rt(T) of PSS-78 in Q1.15 from -2 to 35 C in 1 C steps.
+#define EC_RT_ENTRIES 38
+
+const uint16_t rtTable[EC_RT_ENTRIES] PROGMEM = {
+  20871, 21518, 22171, 22832, 23500, 24175, 24856, 25545, 26240, 26941,
+  27649, 28363, 29083, 29808, 30540, 31277, 32020, 32768, 33521, 34280,
+  35044, 35812, 36585, 37363, 38146, 38932, 39724, 40519, 41318, 42122,
+  42929, 43740, 44554, 45372, 46193, 47018, 47845, 48676
+};
+
+// PSS-78 salinity series, S = a(sqrt(r)) + (T - 15) / (1 + 0.0162 (T - 15)) b(sqrt(r))
+#ifdef EC_FIXED_POINT
+const q16 pss78a[6] PROGMEM = { Q16(0.008), Q16(-0.1692), Q16(25.3851), Q16(14.0941), Q16(-7.0261), Q16(2.7081) };
+const q16 pss78b[6] PROGMEM = { Q16(0.0005), Q16(-0.0056), Q16(-0.0066), Q16(-0.0375), Q16(0.0636), Q16(-0.0144) };
+#else // ifdef EC_FIXED_POINT
+const float pss78a[6] PROGMEM = { 0.008, -0.1692, 25.3851, 14.0941, -7.0261, 2.7081 };
+const float pss78b[6] PROGMEM = { 0.0005, -0.0056, -0.0066, -0.0375, 0.0636, -0.0144 };
+#endif // ifdef EC_FIXED_POINT
+
+// The temperature dependent part of _salinity(), see salinityLookup().
+struct salinity_terms
+{
+  int16_t tempRaw; // looked up for
+  ecvalue rt;      // 42.9 rt(T)
+  ecvalue c[6];    // a + b scaled for T, lowest power first
+} salinityTerms = { EC_TEMP_RAW_NONE, 0, { 0, 0, 0, 0, 0, 0 } };
+
 volatile uint8_t reg_position;
 const uint8_t    reg_size = sizeof(i2c_register);
 
+// Registers kept in EEPROM. Writes to them only set eepromDirty, loop()
+// then saves them all as one record with saveEEPROM().
+struct persisted
+{
+  uint8_t reg;
+  uint8_t size;
+};
+
+const persisted persist[] PROGMEM = {
+  { EC_K_REGISTER,                  4 },
+  { EC_CALIBRATE_REFHIGH_REGISTER,  4 },
+  { EC_CALIBRATE_REFLOW_REGISTER,   4 },
+  { EC_CALIBRATE_READHIGH_REGISTER, 4 },
+  { EC_CALIBRATE_READLOW_REGISTER,  4 },
+  { EC_CALIBRATE_OFFSET_REGISTER,   4 },
+  { EC_DRY_REGISTER,                4 },
+  { EC_TEMP_COMPENSATION_REGISTER,  1 },
+  { EC_CONFIG_REGISTER,             1 },
+  { EC_OVERSAMPLE_REGISTER,         1 },
+  { EC_DISCHARGE_REGISTER,          1 },
+  { EC_TEMP_BUDGET_REGISTER,        1 },
+  { EC_TEMP_INTERVAL_REGISTER,      1 },
+  { EC_TEMP_SOURCE_REGISTER,        1 }
+};
+
+#define EC_PERSISTED (sizeof(persist) / sizeof(persist[0]))
+
+// Records rotate through a ring of slots so each save wears a different
+// part of the EEPROM: EC_RECORD_MAGIC, the number of persist[] entries
+// saved, those registers in persist[] order, a sequence number and an
+// inverted CRC-8 of all of it. The newest valid record wins. persist[]
+// only ever grows at the end, a record with fewer entries comes from older
+// firmware and the registers it lacks keep their defaults.
+#define EC_RECORD_START 256                  /*!< EEPROM address of slot 0 */
+#define EC_RECORD_SIZE 42                    /*!< fixed, slots stay put as persist[] grows, room for 38 register bytes */
+#define EC_RECORD_SLOTS ((E2END + 1 - EC_RECORD_START) / EC_RECORD_SIZE) /*!< slots that fit below E2END */
+#define EC_RECORD_MAGIC 0xEC                 /*!< first byte of a record */
+#define EC_RECORD_SETTLE 50                  /*!< ms without a register write before saving */
+
+volatile bool     eepromDirty;   // persisted registers changed since the last record
+volatile uint32_t eepromChanged; // millis() of the last change
+uint8_t recordAt = EC_RECORD_SIZE; // next byte saveEEPROM() writes, EC_RECORD_SIZE when idle
+uint8_t recordCrc;               // CRC of the record it is writing
+uint8_t recordSlot;              // slot of the newest record
+uint8_t recordSeq;               // its sequence number
+
 #define DS18_PIN 5
 #define EC_PIN 3
 #define POWER_PIN 1
 #define SINK 4
 
+#define ADC_OVERSAMPLE_MAX 12 /*!< 4096 samples, 6 extra bits */
+
+#define EC_DISCHARGE_THRESHOLD 2 /*!< ADC counts of residual electrode voltage */
+#define EC_DISCHARGE_POLL 10     /*!< ms the cell stays shorted between checks */
+#define EC_DISCHARGE_DEFAULT 100 /*!< 1 s, the fixed settle time it replaces */
+#define EC_TEMP_POLL 10          /*!< ms between DS18B20 conversion-done checks */
+#define EC_TEMP_BUDGET_DEFAULT 75 /*!< 750 ms, the 12 bit resolution it replaces */
+#define EC_TEMP_AGE_TICK 100      /*!< ms per tempAge count */
+
 #define adc_disable() (ADCSRA &= ~(1 << ADEN)) // disable ADC (before power-off)
 #define adc_enable() (ADCSRA |=  (1 << ADEN))  // re-enable ADC
 #define ac_disable() ACSR    |= _BV(ACD);      // disable analog comparator
@@ -81,24 +267,69 @@ const uint8_t    reg_size = sizeof(i2c_register);
 OneWire oneWire(DS18_PIN);
 DallasTemperature ds18(&oneWire);
 
+void  startADC(uint8_t channel, uint8_t oversample, bool bipolar);
+double readADC();
+uint8_t temperatureResolution();
+void  findTemperatureSensors();
+void  startTemperature();
+void  readTemperature();
+void  startConductivity(uint8_t task);
+void  startDischarge();
+void  discharge();
 float measureConductivity();
+void  sampleConductivity();
+float convertConductivity();
+void  selectConversion();
 void  calibrateProbe();
 void  calibrateLow();
 void  calibrateHigh();
 
 void  sleep();
-void  _salinity(float temp);
+bool  _salinity(int16_t tempRaw);
+void  salinityLookup(int16_t tempRaw);
+void  compensate(int16_t tempRaw);
+int16_t celsiusToRaw(float tempC);
 void  setI2CAddress();
 void  calibrateDry();
+void  publish();
+void  markDirty(uint8_t position);
+void  saveEEPROM();
+uint8_t recordByte(uint8_t i);
+void  unpackRecord(uint16_t address, uint8_t entries);
+bool  loadRecord();
 
 bool runEC             = false;
 bool runTemp           = false;
+bool runECTemp         = false;
 bool runCalibrateProbe = false;
 bool runCalibrateHigh  = false;
 bool runCalibrateLow   = false;
 bool runI2CAddress     = false;
 bool runDry            = false;
 
+volatile uint32_t adcTotal; // running sum of the free-running ADC
+volatile uint16_t adcCount; // conversions summed into adcTotal
+volatile bool     adcDone;  // adcSamples reached, ADC stopped
+uint16_t adcSamples;        // conversions to sum, 1 << adcOversample
+uint8_t  adcOversample;     // depth the sum in flight was started with
+bool     adcBipolar;        // flip the probe's drive after every sample
+uint8_t ecTask = 0;         // task holding the probe, 0 when idle
+bool    ecPending = false;  // ecRatio sampled, waiting for the temperature
+
+bool     discharging    = false; // probe shorted after a reading
+bool     dischargeProbe = false; // POWER_PIN floated while the ADC checks
+uint32_t dischargeStart;
+uint32_t dischargeCheck;
+
+bool     tempConverting = false; // DS18B20 conversion started, not yet read
+uint8_t  tempBits       = 0;     // resolution the DS18B20 was set to, 0 before the first
+DeviceAddress tempSensors[EC_TEMP_SENSORS]; // ROMs, see findTemperatureSensors()
+uint8_t  tempSensorCount = 0;    // of them valid
+uint32_t tempStart;
+uint32_t tempCheck;
+uint32_t tempDue;                // next background reading, see tempInterval
+volatile uint32_t tempAgeTick;   // millis() tempAge last counted from, see receiveEvent()
+
 static const int pinResistance = 25;
 static const int Resistor      = 500;
 
@@ -112,7 +343,9 @@ static const int Resistor      = 500;
 void inline low_power()
 {
   set_sleep_mode(SLEEP_MODE_IDLE);
-  adc_disable();
+
+  // idle mode keeps the ADC clocked, its interrupt wakes us per sample
+  if (bit_is_clear(ADCSRA, ADIE)) adc_disable();
   ac_disable();
   sleep_enable();
   sleep_mode();